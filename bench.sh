@@ -15,4 +15,10 @@ perf stat -- ./radix 0 0 0 >>$REPFILE 2>&1
 perf stat -- ./radix 0 1 0 >>$REPFILE 2>&1
 perf stat -- ./radix 0 0 1 >>$REPFILE 2>&1
 perf stat -- ./radix 0 1 1 >>$REPFILE 2>&1
+# per-phase hardware counters for each key type and allocation mode
+for KTYPE in uint32_t uint64_t float double; do
+	for MODE in "0 0" "0 1" "1 0" "1 1"; do
+		./radix 0 $MODE $KTYPE >>$REPFILE 2>&1
+	done
+done
 make bench >>$REPFILE 2>&1
@@ -6,10 +6,27 @@
 #include <cstdlib>
 #include <cstring>
 #include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
 
 #include <benchmark/benchmark.h>
 #include "radix_sort.hpp"
 #include "radix_sort_rank.hpp"
+#include "radix_sort_permute.hpp"
+#include "radix_sort_segmented.hpp"
+#include "radix_sort_merge.hpp"
+#include "radix_sort_file.hpp"
+#include "radix_sort_lazy.hpp"
+#include "radix_sort_histogram.hpp"
+#include "radix_sort_adaptive.hpp"
+#include "radix_sort_inplace.hpp"
+#include "radix_sort_partition.hpp"
+#include "radix_sort_msd.hpp"
+#include "radix_sort_onesweep.hpp"
+#include "radix_sort_shard.hpp"
+#include "radix_sort_pack.hpp"
+#include "radix_bench_data.hpp"
 
 static void* read_file(const char *filename, size_t *limit) {
 	void *keys = NULL;
@@ -106,6 +123,99 @@ BENCHMARK_DEFINE_F(FSu32, radix_sort_rank)(benchmark::State &state) {
 	UpdateCounters(state);
 }
 
+BENCHMARK_DEFINE_F(FSu32, radix_sort_rank_apply)(benchmark::State &state) {
+	if (n > max_n)
+		state.SkipWithError("Not enough source data to benchmark!");
+	for (auto _ : state) {
+		auto *sorted_ranks = radix_sort_rank(src, aux_rank, n);
+		rs_apply_rank(src, aux, sorted_ranks, n);
+	}
+	UpdateCounters(state);
+}
+
+BENCHMARK_DEFINE_F(FSu32, radix_sort_rank_apply_mt)(benchmark::State &state) {
+	if (n > max_n)
+		state.SkipWithError("Not enough source data to benchmark!");
+	for (auto _ : state) {
+		auto *sorted_ranks = radix_sort_rank(src, aux_rank, n);
+		rs_apply_rank_parallel(src, aux, sorted_ranks, n);
+	}
+	UpdateCounters(state);
+}
+
+// An ingest scan over the keys (here a checksum) followed by a sort; with radix_sort, and with
+// the histograms built during the scan, block by block, for radix_sort_with_histogram.
+BENCHMARK_DEFINE_F(FSu32, scan_then_radix_sort)(benchmark::State &state) {
+	if (n > max_n)
+		state.SkipWithError("Not enough source data to benchmark!");
+	for (auto _ : state) {
+		state.PauseTiming();
+		std::memcpy(src, org_data, sizeof(*src) * n);
+		state.ResumeTiming();
+		uint32_t sum = 0;
+		for (size_t i = 0 ; i < n ; ++i) {
+			sum ^= src[i];
+		}
+		benchmark::DoNotOptimize(sum);
+		benchmark::DoNotOptimize(radix_sort(src, aux, n));
+	}
+	UpdateCounters(state);
+}
+
+BENCHMARK_DEFINE_F(FSu32, scan_with_histogram)(benchmark::State &state) {
+	if (n > max_n)
+		state.SkipWithError("Not enough source data to benchmark!");
+	radix_histogram<uint32_t> hist;
+	for (auto _ : state) {
+		state.PauseTiming();
+		std::memcpy(src, org_data, sizeof(*src) * n);
+		hist.clear();
+		state.ResumeTiming();
+		uint32_t sum = 0;
+		for (size_t b = 0 ; b < n ; b += 4096) {
+			size_t len = std::min<size_t>(4096, n - b);
+			for (size_t i = b ; i < b + len ; ++i) {
+				sum ^= src[i];
+			}
+			hist.add(src + b, len);
+		}
+		benchmark::DoNotOptimize(sum);
+		benchmark::DoNotOptimize(radix_sort_with_histogram(src, aux, n, hist));
+	}
+	UpdateCounters(state);
+}
+
+// Reading the first n keys of the file and sorting them; with a blocking read before the
+// sort, and with radix_sort_fd, which histograms each block as it's read.
+BENCHMARK_DEFINE_F(FSu32, read_then_radix_sort)(benchmark::State &state) {
+	if (n > max_n)
+		state.SkipWithError("Not enough source data to benchmark!");
+	int fd = open("40M_32bit_keys.dat", O_RDONLY);
+	for (auto _ : state) {
+		lseek(fd, 0, SEEK_SET);
+		if (read(fd, src, n * sizeof(uint32_t)) != ssize_t(n * sizeof(uint32_t)))
+			state.SkipWithError("Short read!");
+		auto *sorted = radix_sort(src, aux, n);
+		benchmark::DoNotOptimize(sorted);
+	}
+	close(fd);
+	UpdateCounters(state);
+}
+
+BENCHMARK_DEFINE_F(FSu32, radix_sort_fd)(benchmark::State &state) {
+	if (n > max_n)
+		state.SkipWithError("Not enough source data to benchmark!");
+	int fd = open("40M_32bit_keys.dat", O_RDONLY);
+	for (auto _ : state) {
+		lseek(fd, 0, SEEK_SET);
+		size_t len = n;
+		auto *sorted = radix_sort_fd(fd, src, aux, &len);
+		benchmark::DoNotOptimize(sorted);
+	}
+	close(fd);
+	UpdateCounters(state);
+}
+
 BENCHMARK_DEFINE_F(FSu32, StdSort)(benchmark::State &state) {
 	if (n > max_n)
 		state.SkipWithError("Not enough source data to benchmark!");
@@ -132,9 +242,385 @@ BENCHMARK_DEFINE_F(FSu32, QSort)(benchmark::State &state) {
 	UpdateCounters(state);
 }
 
+// Sorting pointers to records scattered in memory, with a KDF that dereferences
+// the pointer. Used to sweep over prefetch distances; a distance of zero means
+// no prefetching.
+class PtrSort : public ::benchmark::Fixture {
+public:
+	struct rec {
+		uint32_t key;
+		uint32_t pad[15];
+	};
+
+	void SetUp(const ::benchmark::State& state) {
+		n = state.range(0);
+		recs = new rec[n];
+		org = new const rec*[n];
+		src = new const rec*[n];
+		aux = new const rec*[n];
+		aux_rank = new uint32_t[n*2];
+		std::mt19937 generator(n);
+		for (size_t i = 0 ; i < n ; ++i) {
+			recs[i].key = generator();
+			org[i] = &recs[i];
+		}
+		std::shuffle(org, org + n, generator);
+	}
+
+	void TearDown(const ::benchmark::State&) {
+		delete[] recs;
+		delete[] org;
+		delete[] src;
+		delete[] aux;
+		delete[] aux_rank;
+	}
+
+	static uint32_t kf(const rec* entry) {
+		return entry->key;
+	}
+
+	rec *recs;
+	const rec **org;
+	const rec **src;
+	const rec **aux;
+	uint32_t *aux_rank;
+	size_t n;
+};
+
+BENCHMARK_DEFINE_F(PtrSort, radix_sort_prefetch)(benchmark::State &state) {
+	size_t distance = state.range(1);
+	for (auto _ : state) {
+		state.PauseTiming();
+		std::memcpy(src, org, sizeof(*src) * n);
+		state.ResumeTiming();
+		if (distance == 0) {
+			radix_sort(src, aux, n, kf);
+		} else {
+			radix_sort(src, aux, n, kf, rs_alloc_malloc(), rs_prefetch { distance });
+		}
+	}
+	state.counters["KeyRate"] = benchmark::Counter(state.iterations() * n, benchmark::Counter::kIsRate);
+}
+
+// The keys derived once, with basic_kdfs::cached, or in every pass with prefetching.
+BENCHMARK_DEFINE_F(PtrSort, radix_sort_cached)(benchmark::State &state) {
+	for (auto _ : state) {
+		state.PauseTiming();
+		std::memcpy(src, org, sizeof(*src) * n);
+		state.ResumeTiming();
+		if (state.range(1)) {
+			radix_sort(src, aux, n, basic_kdfs::cached(kf));
+		} else {
+			radix_sort(src, aux, n, kf, rs_alloc_malloc(), rs_prefetch());
+		}
+	}
+	state.counters["KeyRate"] = benchmark::Counter(state.iterations() * n, benchmark::Counter::kIsRate);
+}
+
+BENCHMARK_DEFINE_F(PtrSort, radix_sort_rank_prefetch)(benchmark::State &state) {
+	size_t distance = state.range(1);
+	for (auto _ : state) {
+		if (distance == 0) {
+			radix_sort_rank(org, aux_rank, n, kf);
+		} else {
+			radix_sort_rank(org, aux_rank, n, kf, rs_prefetch { distance });
+		}
+	}
+	state.counters["KeyRate"] = benchmark::Counter(state.iterations() * n, benchmark::Counter::kIsRate);
+}
+
 BENCHMARK_REGISTER_F(FSu32, radix_sort)->RangeMultiplier(10)->Range(1, 40000000);
 BENCHMARK_REGISTER_F(FSu32, StdSort)->RangeMultiplier(10)->Range(1, 40000000);
 BENCHMARK_REGISTER_F(FSu32, QSort)->RangeMultiplier(10)->Range(1, 40000000);
 BENCHMARK_REGISTER_F(FSu32, radix_sort_rank)->RangeMultiplier(10)->Range(1, 40000000);
+BENCHMARK_REGISTER_F(FSu32, radix_sort_rank_apply)->RangeMultiplier(10)->Range(1, 40000000);
+BENCHMARK_REGISTER_F(FSu32, radix_sort_rank_apply_mt)->RangeMultiplier(10)->Range(1, 40000000);
+BENCHMARK_REGISTER_F(FSu32, scan_then_radix_sort)->Arg(100000)->Arg(1000000)->Arg(4000000);
+BENCHMARK_REGISTER_F(FSu32, scan_with_histogram)->Arg(100000)->Arg(1000000)->Arg(4000000);
+BENCHMARK_REGISTER_F(FSu32, read_then_radix_sort)->RangeMultiplier(10)->Range(100000, 40000000);
+BENCHMARK_REGISTER_F(FSu32, radix_sort_fd)->RangeMultiplier(10)->Range(100000, 40000000);
+BENCHMARK_REGISTER_F(PtrSort, radix_sort_prefetch)->ArgsProduct({{100000, 10000000}, {0, 2, 4, 8, 16, 32, 64}});
+BENCHMARK_REGISTER_F(PtrSort, radix_sort_cached)->ArgsProduct({{100000, 10000000}, {0, 1}});
+BENCHMARK_REGISTER_F(PtrSort, radix_sort_rank_prefetch)->ArgsProduct({{100000, 10000000}, {0, 2, 4, 8, 16, 32, 64}});
+
+// Segmented sort of 2^22 uint32_t in segments of random length up to twice range(0).
+// range(1) selects: 0 = radix_sort per segment, 1 = radix_sort_segmented, 2 = the parallel version.
+static void SegSort(benchmark::State& state) {
+	size_t n = 1 << 22;
+	std::mt19937 gen(n);
+	std::uniform_int_distribution<size_t> seg_len(0, state.range(0) * 2);
+	std::vector<size_t> offsets = { 0 };
+	while (offsets.back() < n) {
+		offsets.push_back(std::min(n, offsets.back() + seg_len(gen)));
+	}
+	size_t nseg = offsets.size() - 1;
+	std::vector<uint32_t> org(n);
+	std::vector<uint32_t> src(n);
+	std::vector<uint32_t> aux(n);
+	rs_generate(org.data(), n, rs_dist::uniform, n);
+
+	for (auto _ : state) {
+		state.PauseTiming();
+		std::copy(org.begin(), org.end(), src.begin());
+		state.ResumeTiming();
+		switch (state.range(1)) {
+			case 0:
+				for (size_t s = 0 ; s < nseg ; ++s) {
+					benchmark::DoNotOptimize(radix_sort(src.data() + offsets[s], aux.data() + offsets[s], offsets[s + 1] - offsets[s]));
+				}
+				break;
+			case 1:
+				radix_sort_segmented(src.data(), offsets.data(), nseg);
+				break;
+			default:
+				radix_sort_segmented_parallel(src.data(), offsets.data(), nseg);
+				break;
+		}
+		benchmark::ClobberMemory();
+	}
+	state.counters["KeyRate"] = benchmark::Counter(state.iterations() * n, benchmark::Counter::kIsRate);
+	state.counters["SegRate"] = benchmark::Counter(state.iterations() * nseg, benchmark::Counter::kIsRate);
+}
+
+BENCHMARK(SegSort)->ArgsProduct({{16, 64, 256, 4096}, {0, 1, 2}});
+
+// k-way merge of 8 sorted chunks of range(0) uint32_t, with range(1) threads, zero meaning the default.
+static void MergeK(benchmark::State& state) {
+	constexpr size_t k = 8;
+	size_t len = state.range(0);
+	std::vector<uint32_t> chunks(k * len);
+	std::vector<uint32_t> dst(k * len);
+	std::vector<uint32_t> aux(k * len);
+	const uint32_t *spans[k];
+	size_t lens[k];
+	rs_generate(chunks.data(), chunks.size(), rs_dist::uniform, len);
+	for (size_t i = 0 ; i < k ; ++i) {
+		std::sort(chunks.begin() + i * len, chunks.begin() + (i + 1) * len);
+		spans[i] = chunks.data() + i * len;
+		lens[i] = len;
+	}
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(radix_merge_k(spans, lens, k, dst.data(), aux.data(), basic_kdfs::kdf<uint32_t>, state.range(1)));
+	}
+	state.counters["KeyRate"] = benchmark::Counter(state.iterations() * k * len, benchmark::Counter::kIsRate);
+}
+
+BENCHMARK(MergeK)->ArgsProduct({{1 << 12, 1 << 16, 1 << 20}, {1, 0}});
+
+// Reading the first range(1) of 2^24 uniform uint32_t in sorted order, lazily, or
+// with a full radix_sort when range(0) is zero.
+static void LazyFirstK(benchmark::State& state) {
+	size_t n = 1 << 24;
+	size_t k = state.range(1);
+	std::vector<uint32_t> src(n);
+	std::vector<uint32_t> buf(n);
+	std::vector<uint32_t> aux(n);
+	rs_generate(src.data(), n, rs_dist::uniform, n);
+
+	for (auto _ : state) {
+		uint64_t sum = 0;
+		if (state.range(0)) {
+			radix_sorted_range range(src.data(), buf.data(), aux.data(), n);
+			size_t i = 0;
+			for (auto it = range.begin() ; i < k && it != range.end() ; ++it, ++i) {
+				sum += *it;
+			}
+		} else {
+			std::copy(src.begin(), src.end(), buf.begin());
+			uint32_t *sorted = radix_sort(buf.data(), aux.data(), n);
+			for (size_t i = 0 ; i < k ; ++i) {
+				sum += sorted[i];
+			}
+		}
+		benchmark::DoNotOptimize(sum);
+	}
+	state.counters["KeyRate"] = benchmark::Counter(state.iterations() * n, benchmark::Counter::kIsRate);
+}
+
+BENCHMARK(LazyFirstK)->ArgsProduct({{0, 1}, {1, 1 << 16, 1 << 24}});
+
+// Sorting 2^range(0) uniform uint64_t with radix_sort_inplace on range(1) threads, or
+// with radix_sort, and its n-sized auxiliary buffer, when range(1) is zero.
+static void InplaceSort(benchmark::State& state) {
+	size_t n = 1ULL << state.range(0);
+	unsigned int threads = state.range(1);
+	std::vector<uint64_t> org(n);
+	std::vector<uint64_t> src(n);
+	std::vector<uint64_t> aux(threads ? 0 : n);
+	rs_generate(org.data(), n, rs_dist::uniform, n);
+
+	for (auto _ : state) {
+		state.PauseTiming();
+		std::copy(org.begin(), org.end(), src.begin());
+		state.ResumeTiming();
+		if (threads) {
+			benchmark::DoNotOptimize(radix_sort_inplace(src.data(), n, basic_kdfs::kdf_object(), threads));
+		} else {
+			benchmark::DoNotOptimize(radix_sort(src.data(), aux.data(), n));
+		}
+	}
+	state.counters["KeyRate"] = benchmark::Counter(state.iterations() * n, benchmark::Counter::kIsRate);
+}
+
+BENCHMARK(InplaceSort)->ArgsProduct({{16, 20, 24}, {0, 1, 2, 4}});
+
+// Sorting 2^range(0) uniform uint64_t in range(1) worker processes, or with radix_sort for 0.
+// Timed by the wall clock, as the workers' CPU time isn't the benchmark process'.
+static void ShardedSort(benchmark::State& state) {
+	size_t n = 1ULL << state.range(0);
+	unsigned int shards = state.range(1);
+	std::vector<uint64_t> org(n);
+	std::vector<uint64_t> src(n);
+	std::vector<uint64_t> aux(shards ? 0 : n);
+	rs_generate(org.data(), n, rs_dist::uniform, n);
 
-BENCHMARK_MAIN();
+	for (auto _ : state) {
+		state.PauseTiming();
+		std::copy(org.begin(), org.end(), src.begin());
+		state.ResumeTiming();
+		if (shards) {
+			benchmark::DoNotOptimize(radix_sort_sharded(src.data(), n, basic_kdfs::kdf_object(), shards));
+		} else {
+			benchmark::DoNotOptimize(radix_sort(src.data(), aux.data(), n));
+		}
+	}
+	state.counters["KeyRate"] = benchmark::Counter(state.iterations() * n, benchmark::Counter::kIsRate);
+}
+
+BENCHMARK(ShardedSort)->ArgsProduct({{20, 24}, {0, 1, 4}})->UseRealTime();
+
+// Partitioning 2^24 uniform uint32_t on range(0) bits, with range(1) threads.
+static void Partition(benchmark::State& state) {
+	size_t n = 1 << 24;
+	unsigned int bits = state.range(0);
+	unsigned int threads = state.range(1);
+	std::vector<uint32_t> src(n);
+	std::vector<uint32_t> dst(n);
+	rs_generate(src.data(), n, rs_dist::uniform, n);
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(radix_partition(src.data(), dst.data(), n, bits, 0, basic_kdfs::kdf_object(), threads));
+	}
+	state.counters["KeyRate"] = benchmark::Counter(state.iterations() * n, benchmark::Counter::kIsRate);
+	state.SetBytesProcessed(state.iterations() * n * sizeof(uint32_t));
+}
+
+BENCHMARK(Partition)->ArgsProduct({{4, 6, 8, 10, 12, 14}, {1, 4}});
+
+// Writing 2^22 sorted T, with random gaps of up to 2^range(0), to memory: as a raw array
+// for range(1) = 0, encoded with radix_pack_sorted for 1, or decoded from that for 2.
+template<typename T>
+static void PackSorted(benchmark::State& state) {
+	size_t n = 1 << 22;
+	unsigned int gap_bits = state.range(0);
+	int mode = state.range(1);
+	std::vector<T> src(n);
+	std::vector<T> dst(n);
+	std::vector<uint8_t> packed(rs_pack_bound<T>(n));
+	std::default_random_engine generator;
+	std::uniform_int_distribution<uint64_t> distribution(0, (1ULL << gap_bits) - 1);
+	T v = 0;
+	for (auto& e : src) {
+		e = v += distribution(generator);
+	}
+	size_t bytes = radix_pack_sorted(src.data(), n, packed.data());
+
+	for (auto _ : state) {
+		if (mode == 0) {
+			std::copy(src.begin(), src.end(), dst.begin());
+		} else if (mode == 1) {
+			benchmark::DoNotOptimize(radix_pack_sorted(src.data(), n, packed.data()));
+		} else {
+			benchmark::DoNotOptimize(radix_unpack_sorted(packed.data(), bytes, n, dst.data()));
+		}
+		benchmark::ClobberMemory();
+	}
+	state.counters["KeyRate"] = benchmark::Counter(state.iterations() * n, benchmark::Counter::kIsRate);
+	state.counters["BitsPerKey"] = mode ? 8.0 * bytes / n : 8.0 * sizeof(T);
+}
+
+BENCHMARK(PackSorted<uint32_t>)->ArgsProduct({{4, 8, 9}, {0, 1, 2}});
+BENCHMARK(PackSorted<uint64_t>)->ArgsProduct({{4, 16, 36}, {0, 1, 2}});
+
+// Distribution suite. Each combination of type and distribution is benchmarked with
+// radix_sort, radix_sort_adaptive, radix_sort_msd_parallel, radix_sort_onesweep and std::sort. The input is
+// restored before every iteration.
+enum class dist_sorter { radix_sort, adaptive, msd_parallel, onesweep, std_sort };
+
+template<typename T>
+static void DistSort(benchmark::State& state, rs_dist dist, dist_sorter sorter) {
+	size_t n = state.range(0);
+	std::vector<T> org(n);
+	std::vector<T> src(n);
+	std::vector<T> aux(n);
+	rs_generate(org.data(), n, dist, n);
+
+	for (auto _ : state) {
+		state.PauseTiming();
+		std::copy(org.begin(), org.end(), src.begin());
+		state.ResumeTiming();
+		if (sorter == dist_sorter::std_sort) {
+			std::sort(src.begin(), src.end());
+		} else if constexpr (std::is_arithmetic_v<T>) {
+			if (sorter == dist_sorter::adaptive) {
+				benchmark::DoNotOptimize(radix_sort_adaptive(src.data(), aux.data(), n));
+			} else if (sorter == dist_sorter::msd_parallel) {
+				benchmark::DoNotOptimize(radix_sort_msd_parallel(src.data(), aux.data(), n));
+			} else if (sorter == dist_sorter::onesweep) {
+				benchmark::DoNotOptimize(radix_sort_onesweep(src.data(), aux.data(), n));
+			} else {
+				benchmark::DoNotOptimize(radix_sort(src.data(), aux.data(), n));
+			}
+		} else {
+			if (sorter == dist_sorter::adaptive) {
+				benchmark::DoNotOptimize(radix_sort_adaptive(src.data(), aux.data(), n, kdf_bench_rec<sizeof(T)>));
+			} else if (sorter == dist_sorter::msd_parallel) {
+				benchmark::DoNotOptimize(radix_sort_msd_parallel(src.data(), aux.data(), n, kdf_bench_rec<sizeof(T)>));
+			} else if (sorter == dist_sorter::onesweep) {
+				benchmark::DoNotOptimize(radix_sort_onesweep(src.data(), aux.data(), n, kdf_bench_rec<sizeof(T)>));
+			} else {
+				benchmark::DoNotOptimize(radix_sort(src.data(), aux.data(), n, kdf_bench_rec<sizeof(T)>));
+			}
+		}
+	}
+	state.counters["KeyRate"] = benchmark::Counter(state.iterations() * n, benchmark::Counter::kIsRate);
+	state.SetBytesProcessed(state.iterations() * n * sizeof(T));
+}
+
+template<typename T>
+static void RegisterDistSort(const char *type_name) {
+	const struct { dist_sorter sorter; const char *name; } sorters[] = {
+		{ dist_sorter::radix_sort, "radix_sort/" }, { dist_sorter::adaptive, "adaptive/" }, { dist_sorter::msd_parallel, "msd_parallel/" }, { dist_sorter::onesweep, "onesweep/" }, { dist_sorter::std_sort, "StdSort/" },
+	};
+	for (rs_dist dist : rs_dists) {
+		for (const auto& s : sorters) {
+			std::string name = std::string("DistSort/") + s.name + type_name + "/" + rs_dist_name(dist);
+			benchmark::RegisterBenchmark(name.c_str(), DistSort<T>, dist, s.sorter)->Arg(1 << 10)->Arg(1 << 16)->Arg(1 << 22);
+		}
+	}
+}
+
+int main(int argc, char *argv[]) {
+	RegisterDistSort<uint8_t>("uint8_t");
+	RegisterDistSort<uint16_t>("uint16_t");
+	RegisterDistSort<uint32_t>("uint32_t");
+	RegisterDistSort<uint64_t>("uint64_t");
+	RegisterDistSort<int8_t>("int8_t");
+	RegisterDistSort<int16_t>("int16_t");
+	RegisterDistSort<int32_t>("int32_t");
+	RegisterDistSort<int64_t>("int64_t");
+	RegisterDistSort<float>("float");
+	RegisterDistSort<double>("double");
+	RegisterDistSort<bench_rec<16>>("rec16");
+	RegisterDistSort<bench_rec<32>>("rec32");
+	RegisterDistSort<bench_rec<64>>("rec64");
+	RegisterDistSort<bench_rec<128>>("rec128");
+
+	benchmark::Initialize(&argc, argv);
+	if (benchmark::ReportUnrecognizedArguments(argc, argv))
+		return 1;
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	return 0;
+}
@@ -0,0 +1,194 @@
+/*
+	Deterministic, in-process generation of benchmark input with different distributions.
+
+	See https://github.com/eloj/radix-sorting#cpp-benchmark
+*/
+#pragma once
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+enum class rs_dist {
+	uniform,       // Uniformly random, over the full range for integers.
+	zipf,          // Zipf-distributed (s=1.1) over 2^16 distinct random values.
+	sorted,        // Uniform, sorted.
+	reversed,      // Uniform, reverse sorted.
+	nearly_sorted, // Uniform, sorted, then 1% of entries swapped at random.
+	few_unique,    // Only 16 distinct random values.
+	masked,        // Uniform, with the most significant byte cleared.
+	normal,        // Normal distribution, centered in the range of the type.
+};
+
+constexpr rs_dist rs_dists[] = {
+	rs_dist::uniform, rs_dist::zipf, rs_dist::sorted, rs_dist::reversed,
+	rs_dist::nearly_sorted, rs_dist::few_unique, rs_dist::masked, rs_dist::normal,
+};
+
+inline const char* rs_dist_name(rs_dist dist) {
+	switch (dist) {
+		case rs_dist::uniform: return "uniform";
+		case rs_dist::zipf: return "zipf";
+		case rs_dist::sorted: return "sorted";
+		case rs_dist::reversed: return "reversed";
+		case rs_dist::nearly_sorted: return "nearly_sorted";
+		case rs_dist::few_unique: return "few_unique";
+		case rs_dist::masked: return "masked";
+		case rs_dist::normal: return "normal";
+	}
+	return "unknown";
+}
+
+// Fixed-size record with a 32-bit key, for measuring the cost of moving payload.
+template<size_t Size>
+struct bench_rec {
+	static_assert(Size > sizeof(uint32_t), "Record too small");
+	uint32_t key;
+	char payload[Size - sizeof(uint32_t)];
+
+	bool operator<(const bench_rec& other) const {
+		return key < other.key;
+	}
+};
+
+template<size_t Size>
+uint32_t kdf_bench_rec(const bench_rec<Size>& entry) {
+	return entry.key;
+}
+
+// Sampling of ranks 0..k-1, where rank r has weight 1/(r+1)^s.
+class rs_zipf {
+public:
+	rs_zipf(size_t k, double s) : cdf(k) {
+		double sum = 0;
+		for (size_t i = 0 ; i < k ; ++i) {
+			sum += 1.0 / std::pow(i + 1, s);
+			cdf[i] = sum;
+		}
+		for (auto& c : cdf) {
+			c /= sum;
+		}
+	}
+
+	template<typename Gen>
+	size_t operator()(Gen& gen) {
+		double u = std::uniform_real_distribution<double>(0.0, 1.0)(gen);
+		return std::min<size_t>(std::upper_bound(cdf.begin(), cdf.end(), u) - cdf.begin(), cdf.size() - 1);
+	}
+
+private:
+	std::vector<double> cdf;
+};
+
+template<typename T, typename Gen>
+T rs_gen_uniform(Gen& gen) {
+	if constexpr (std::is_floating_point_v<T>) {
+		return std::uniform_real_distribution<T>(-1e6, 1e6)(gen);
+	} else {
+		return static_cast<T>(gen());
+	}
+}
+
+template<typename T, typename Gen>
+T rs_gen_normal(Gen& gen) {
+	if constexpr (std::is_floating_point_v<T>) {
+		return std::normal_distribution<T>(0, 1)(gen);
+	} else {
+		constexpr double lo = std::numeric_limits<T>::min();
+		constexpr double hi = std::numeric_limits<T>::max();
+		double v = std::normal_distribution<double>(lo / 2 + hi / 2, (hi - lo) / 16)(gen);
+		// The max of 64-bit types is not representable as a double, so stay below it.
+		return static_cast<T>(std::clamp(v, lo, std::nextafter(hi, lo)));
+	}
+}
+
+// Clear the most significant byte of the value's representation, like the
+// <hex-mask> argument of the experiment program. Single-byte types lose the high nibble.
+template<typename T>
+T rs_mask_high(T value) {
+	uint64_t buf = 0;
+	std::memcpy(&buf, &value, sizeof(T));
+	buf &= sizeof(T) == 1 ? 0x0F : ~(0xFFULL << ((sizeof(T) - 1) * 8));
+	std::memcpy(&value, &buf, sizeof(T));
+	return value;
+}
+
+// Fill dst with n values of arithmetic type T drawn from dist.
+// The same arguments always produce the same data.
+template<typename T>
+void rs_generate(T* dst, size_t n, rs_dist dist, uint64_t seed = 1) {
+	static_assert(std::is_arithmetic_v<T>, "T must be arithmetic");
+	std::mt19937_64 gen(seed);
+
+	switch (dist) {
+		case rs_dist::uniform:
+		case rs_dist::sorted:
+		case rs_dist::reversed:
+		case rs_dist::nearly_sorted:
+			for (size_t i = 0 ; i < n ; ++i) {
+				dst[i] = rs_gen_uniform<T>(gen);
+			}
+			break;
+		case rs_dist::zipf: {
+			// Map ranks to random values, so that the frequent keys are spread over the key space.
+			std::vector<T> values(1 << 16);
+			for (auto& v : values) {
+				v = rs_gen_uniform<T>(gen);
+			}
+			rs_zipf zipf(values.size(), 1.1);
+			for (size_t i = 0 ; i < n ; ++i) {
+				dst[i] = values[zipf(gen)];
+			}
+			break;
+		}
+		case rs_dist::few_unique: {
+			T values[16];
+			for (auto& v : values) {
+				v = rs_gen_uniform<T>(gen);
+			}
+			for (size_t i = 0 ; i < n ; ++i) {
+				dst[i] = values[gen() & 15];
+			}
+			break;
+		}
+		case rs_dist::masked:
+			for (size_t i = 0 ; i < n ; ++i) {
+				dst[i] = rs_mask_high(rs_gen_uniform<T>(gen));
+			}
+			break;
+		case rs_dist::normal:
+			for (size_t i = 0 ; i < n ; ++i) {
+				dst[i] = rs_gen_normal<T>(gen);
+			}
+			break;
+	}
+
+	if (dist == rs_dist::sorted || dist == rs_dist::nearly_sorted) {
+		std::sort(dst, dst + n);
+	} else if (dist == rs_dist::reversed) {
+		std::sort(dst, dst + n, std::greater<T>());
+	}
+
+	if (dist == rs_dist::nearly_sorted && n > 1) {
+		for (size_t i = 0 ; i < n / 100 ; ++i) {
+			std::swap(dst[gen() % n], dst[gen() % n]);
+		}
+	}
+}
+
+// Records are generated with keys from dist, and a payload derived from the position.
+template<size_t Size>
+void rs_generate(bench_rec<Size>* dst, size_t n, rs_dist dist, uint64_t seed = 1) {
+	std::vector<uint32_t> keys(n);
+	rs_generate(keys.data(), n, dist, seed);
+	for (size_t i = 0 ; i < n ; ++i) {
+		dst[i].key = keys[i];
+		std::memset(dst[i].payload, i & 0xFF, sizeof(dst[i].payload));
+	}
+}
@@ -7,6 +7,9 @@
 
 	$ ./radix 0 1 0 uint32_t 0x00FFFFFF
 
+	On Linux, hardware performance counters (cycles, L1D/LLC/dTLB misses and branch misses)
+	are collected per sort phase via perf_event_open(2), if available.
+
 	Note: Will not compile on WIN32 in current state.
 */
 #include <cstdio>
@@ -16,11 +19,15 @@
 #include <ctime>
 #include <cassert>
 #include <algorithm>
-#include <sys/mman.h> // for mmap
 
 #include "radix_sort.hpp"
 
-static int RADIX_MMAP_FLAGS = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_POPULATE; // | MAP_HUGE_2MB
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 #ifdef WIN32
 #include <windows.h>
@@ -50,31 +57,155 @@ void timespec_diff(struct timespec *start, struct timespec *stop,
 	}
 }
 
+#ifdef __linux__
+// Per-phase hardware performance counters, on top of the timings of rs_stats.
+// Counters are opened individually so that a missing event doesn't disable the rest,
+// and only count user-space, which is permitted at the default perf_event_paranoid level.
+struct perf_stats : rs_stats {
+	static constexpr int num_events = 5;
+	static constexpr const char *event_names[num_events] = { "cycles", "L1D-miss", "LLC-miss", "dTLB-miss", "br-miss" };
+	// Rows: the non-scatter phases, followed by one row per scattered column.
+	static constexpr size_t num_rows = size_t(rs_phase::num_phases) + 8;
+
+	int fds[num_events];
+	uint64_t begin_values[num_events] = { 0 };
+	uint64_t totals[num_rows][num_events] = {{ 0 }};
+	bool used[num_rows] = { false };
+
+	perf_stats() {
+		constexpr uint64_t cache_read_miss = (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		const uint32_t types[num_events] = { PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE };
+		const uint64_t configs[num_events] = {
+			PERF_COUNT_HW_CPU_CYCLES,
+			PERF_COUNT_HW_CACHE_L1D | cache_read_miss,
+			PERF_COUNT_HW_CACHE_LL | cache_read_miss,
+			PERF_COUNT_HW_CACHE_DTLB | cache_read_miss,
+			PERF_COUNT_HW_BRANCH_MISSES,
+		};
+		for (int i = 0 ; i < num_events ; ++i) {
+			struct perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = types[i];
+			attr.config = configs[i];
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+		}
+	}
+
+	~perf_stats() {
+		for (int i = 0 ; i < num_events ; ++i) {
+			if (fds[i] >= 0)
+				close(fds[i]);
+		}
+	}
+
+	bool available() const {
+		for (int i = 0 ; i < num_events ; ++i) {
+			if (fds[i] >= 0)
+				return true;
+		}
+		return false;
+	}
+
+	void read_counters(uint64_t *values) {
+		for (int i = 0 ; i < num_events ; ++i) {
+			values[i] = 0;
+			if (fds[i] >= 0 && read(fds[i], &values[i], sizeof(values[i])) != sizeof(values[i]))
+				values[i] = 0;
+		}
+	}
+
+	void phase_begin(rs_phase phase, unsigned int col) {
+		read_counters(begin_values);
+		rs_stats::phase_begin(phase, col);
+	}
+
+	void phase_end(rs_phase phase, unsigned int col) {
+		rs_stats::phase_end(phase, col);
+		uint64_t values[num_events];
+		read_counters(values);
+		size_t row = phase == rs_phase::scatter ? size_t(rs_phase::num_phases) + col : size_t(phase);
+		for (int i = 0 ; i < num_events ; ++i) {
+			totals[row][i] += values[i] - begin_values[i];
+		}
+		used[row] = true;
+	}
+
+	void print_counters(FILE *f) const {
+		if (!available()) {
+			fprintf(f, "Hardware performance counters not available.\n");
+			return;
+		}
+		fprintf(f, "%-12s", "phase");
+		for (int i = 0 ; i < num_events ; ++i) {
+			fprintf(f, " %14s", fds[i] >= 0 ? event_names[i] : "n/a");
+		}
+		fprintf(f, "\n");
+		for (size_t row = 0 ; row < num_rows ; ++row) {
+			if (!used[row])
+				continue;
+			if (row < size_t(rs_phase::num_phases)) {
+				fprintf(f, "%-12s", rs_phase_name(rs_phase(row)));
+			} else {
+				fprintf(f, "scatter[%zu]  ", row - size_t(rs_phase::num_phases));
+			}
+			for (int i = 0 ; i < num_events ; ++i) {
+				fprintf(f, " %14" PRIu64, totals[row][i]);
+			}
+			fprintf(f, "\n");
+		}
+	}
+};
+#else
+struct perf_stats : rs_stats {
+	void print_counters(FILE *f) const { }
+};
+#endif
+
+// Allocate using the library allocation policies;
+// mmap (optionally with MAP_HUGETLB), transparent huge pages, or malloc.
 auto my_allocate(size_t size, int use_mmap, int use_huge, const char *usage) -> void* {
 	void *mem = nullptr;
 
 	if (use_mmap) {
-		mem = (uint32_t*)mmap(nullptr, size, PROT_READ | PROT_WRITE, RADIX_MMAP_FLAGS, -1, 0);
-		assert(mem && mem != MAP_FAILED);
+		if (use_huge) {
+			mem = rs_alloc_mmap<true, true>().allocate(size);
+		} else {
+			mem = rs_alloc_mmap<false, true>().allocate(size);
+		}
+		assert(mem);
 		printf("Mapped memory at %p, %zu bytes for %s\n", mem, size, usage);
 	} else {
 		printf("Allocating %zu bytes for %s.\n", size, usage);
 		if (use_huge) {
-			int res = posix_memalign((void**)&mem, 1UL << 21, size);
-			if (res) {
-				fprintf(stderr, "Failed to allocate: %d\n", res); // ENOMEM or EINVAL
+			mem = rs_alloc_thp().allocate(size);
+			if (!mem) {
+				fprintf(stderr, "Failed to allocate %zu bytes\n", size);
 				abort();
 			}
-			madvise(mem, size, MADV_HUGEPAGE);
 			printf("Requested MADV_HUGEPAGE for pages.\n");
 		} else {
-			mem = malloc(size);
+			mem = rs_alloc_malloc().allocate(size);
 		}
 		assert(mem);
 	}
 	return mem;
 }
 
+void my_free(void *mem, size_t size, int use_mmap, int use_huge) {
+	if (use_mmap) {
+		if (use_huge) {
+			rs_alloc_mmap<true, true>().deallocate(mem, size);
+		} else {
+			rs_alloc_mmap<false, true>().deallocate(mem, size);
+		}
+	} else {
+		free(mem);
+	}
+}
+
 static auto read_file(const char *filename, size_t *limit, int use_mmap, int use_huge) -> void* {
 	void *keys = nullptr;
 	size_t bytes = 0;
@@ -94,7 +225,7 @@ static auto read_file(const char *filename, size_t *limit, int use_mmap, int use
 		long rnum = fread(keys, bytes, 1, f);
 		fclose(f);
 		if (rnum != 1) {
-			free(keys);
+			my_free(keys, bytes, use_mmap, use_huge);
 			return nullptr;
 		}
 	}
@@ -200,9 +331,11 @@ auto test_radix_sort(const char *filename, size_t entries, int use_mmap, int use
 	struct timespec tp_start;
 	struct timespec tp_end;
 
+	// Opening the counters isn't part of the sort.
+	perf_stats stats;
 	printf("Sorting %zu entries...\n", n);
 	clock_gettime(CLOCK_MONOTONIC_RAW, &tp_start);
-	auto *sorted = radix_sort(src, aux, n);
+	auto *sorted = radix_sort(src, aux, n, basic_kdfs::kdf<T>, rs_alloc_malloc(), rs_prefetch_none(), &stats);
 	clock_gettime(CLOCK_MONOTONIC_RAW, &tp_end);
 
 #ifdef VERIFY_SORT
@@ -226,14 +359,12 @@ auto test_radix_sort(const char *filename, size_t entries, int use_mmap, int use
 	timespec_diff(&tp_start, &tp_end, &tp_res);
 	double time_ms = (tp_res.tv_sec * 1000) + (tp_res.tv_nsec / 1.0e6f);
 	printf("Sorted %zu entries in %.4f ms\n", n, time_ms);
+	stats.print(stdout);
+	stats.print_counters(stdout);
+
+	my_free(src, bytes, use_mmap, use_huge);
+	my_free(aux, bytes, use_mmap, use_huge);
 
-	if (use_mmap) {
-		munmap(src, bytes);
-		munmap(aux, bytes);
-	} else {
-		free(src);
-		free(aux);
-	}
 	return 0;
 }
 
@@ -253,9 +384,6 @@ auto main(int argc, char *argv[]) -> int
 
 	const char *src_fn = "40M_32bit_keys.dat";
 
-	if (use_huge)
-		RADIX_MMAP_FLAGS |= MAP_HUGETLB;
-
 	printf("src='%s', entries=%d, use_mmap=%d, use_huge=%d, type='%s', mask=0x%08lx \n", src_fn, entries, use_mmap, use_huge, ktype, value_mask);
 
 	int res = 100;
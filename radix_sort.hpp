@@ -11,105 +11,536 @@
 */
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <cinttypes>
 #include <cstring> // for std::memcpy
+#include <type_traits>
+#include <utility>
 
+#include "radix_sort_alloc.hpp"
 #include "radix_sort_basic_kdf.hpp"
+#include "radix_sort_config.hpp"
+#include "radix_sort_permute.hpp"
+#include "radix_sort_prefetch.hpp"
+#include "radix_sort_stats.hpp"
 
 #ifndef RESTRICT
 #define RESTRICT __restrict__
 #endif
 
-// 8xW-bit Radix Sort
-//
-// T is the type being sorted.
-// KeyFunc is the KDF.
-// Hist is storage for the histograms, sized to 256*passes*sizeof(counter-type)
-// KeyType is derived from the return value of the KeyFunc (an unsigned integer)
+// Mask of the bytes of the key that can vary, bit i for byte i. A KDF may declare this with
+// a `static constexpr uint8_t byte_mask` member, see basic_kdfs::with_byte_mask. Otherwise all bytes.
+template<typename KeyFunc, typename KeyType, typename = void>
+struct rs_byte_mask : std::integral_constant<uint8_t, (1U << sizeof(KeyType)) - 1> { };
+
+template<typename KeyFunc, typename KeyType>
+struct rs_byte_mask<KeyFunc, KeyType, std::void_t<decltype(KeyFunc::byte_mask)>> : std::integral_constant<uint8_t, KeyFunc::byte_mask & ((1U << sizeof(KeyType)) - 1)> { };
+
+template<typename KeyFunc, typename KeyType>
+constexpr uint8_t rs_byte_mask_v = rs_byte_mask<std::decay_t<KeyFunc>, KeyType>::value;
+
+constexpr unsigned int rs_popcount(uint8_t mask) {
+	unsigned int n = 0;
+	for ( ; mask ; mask &= mask - 1) {
+		++n;
+	}
+	return n;
+}
+
+// Shift amounts of the bytes set in the mask, from the least significant.
+constexpr std::array<uint8_t, 8> rs_mask_shifts(uint8_t mask) {
+	std::array<uint8_t, 8> shifts {};
+	unsigned int j = 0;
+	for (unsigned int i = 0 ; i < 8 ; ++i) {
+		if (mask & (1U << i))
+			shifts[j++] = i * 8;
+	}
+	return shifts;
+}
+
+// Calls f(std::integral_constant<size_t, I>) for I in 0..N-1, fully unrolled.
+template<typename F, size_t... I>
+inline void rs_unroll_impl(F && f, std::index_sequence<I...>) {
+	(f(std::integral_constant<size_t, I>()), ...);
+}
+
+template<size_t N, typename F>
+inline void rs_unroll(F && f) {
+	rs_unroll_impl(f, std::make_index_sequence<N>());
+}
+
+// True if key a may precede key b in the order asked for by the KDF.
+template<typename KeyFunc, typename KeyType>
+inline bool rs_key_in_order(KeyType a, KeyType b) {
+	return rs_descending_v<KeyFunc> ? a >= b : a <= b;
+}
+
+// Element of the indirect sort. The key is derived once and stored next to the index
+// of the record it came from, so the sorting passes never have to touch the records.
+template<typename KeyType, typename IdxType>
+struct rs_keyidx {
+	KeyType key;
+	IdxType idx;
+};
+
+// Estimate if sorting (key, index)-pairs and gathering the records once is cheaper
+// than moving the records in every pass, in bytes of memory traffic per element.
 //
-template<typename T, typename KeyFunc = decltype(basic_kdfs::kdf<T>), typename Hist, typename KeyType=typename std::result_of_t<KeyFunc&&(T)>>
-T* rs_sort_main(T* RESTRICT src, T* RESTRICT aux, size_t n, Hist& histogram, KeyFunc && kf = basic_kdfs::kdf) {
-	typedef typename Hist::value_type HVT;
-	static_assert(sizeof(KeyType) <= 8, "KeyType must be 64-bits or less");
-	static_assert(std::is_unsigned<KeyType>(), "KeyType must be unsigned");
+// Direct: each pass reads and writes the record.
+// Indirect: write the pairs, read and write them each pass, read them again for the
+// gather, which does one random read (at least a cache-line, weighted by rs_gather_cost)
+// and one sequential write per record.
+template<typename T, typename P>
+constexpr bool rs_prefer_indirect(size_t n, unsigned int ncols) {
+	if (n < rs_indirect_min_n)
+		return false;
+	double direct = 2 * sizeof(T) * ncols;
+	double indirect = sizeof(P) * (2 * ncols + 2) + rs_gather_cost * std::max(sizeof(T), rs_cacheline) + sizeof(T);
+	return indirect < direct;
+}
 
-	if (n < 2)
-		return src;
+// Stable insertion sort on the derived keys, used for small inputs.
+template<typename T, typename KeyFunc>
+T* rs_insertion_sort(T* src, size_t n, KeyFunc && kf) {
+	constexpr bool descending = rs_descending_v<KeyFunc>;
+	for (size_t i = 1 ; i < n ; ++i) {
+		T v = std::move(src[i]);
+		auto k = kf(v);
+		size_t j = i;
+		for ( ; j > 0 && (descending ? kf(src[j-1]) < k : k < kf(src[j-1])) ; --j) {
+			src[j] = std::move(src[j-1]);
+		}
+		src[j] = std::move(v);
+	}
+	return src;
+}
+
+// Insertion sort of inputs smaller than rs_small_n, reported as a comparison sort.
+template<typename T, typename KeyFunc, typename Stats>
+T* rs_sort_small(T* src, size_t n, KeyFunc && kf, Stats *stats) {
+	typedef typename std::result_of_t<KeyFunc&&(T)> KeyType;
+	rs_insertion_sort(src, n, kf);
+	if (stats) {
+		rs_sort_info info;
+		info.n = n;
+		info.key_bytes = rs_popcount(rs_byte_mask_v<KeyFunc, KeyType>);
+		info.strategy = rs_strategy::comparison;
+		stats->done(info);
+	}
+	return src;
+}
 
-	constexpr size_t wc = sizeof(KeyType);
-	constexpr std::array<uint8_t, 8> shift_table = { 0, 8, 16, 24, 32, 40, 48, 56 };
+// Indirect sort, called from rs_sort_main once the histograms have been turned into offsets.
+// Returns aux, or nullptr if the pair buffer could not be allocated.
+template<typename IdxType, typename T, typename KeyFunc, typename Hist, typename KeyType, typename Alloc, typename Stats>
+T* rs_sort_indirect(const T* RESTRICT src, T* RESTRICT aux, size_t n, Hist& histogram, const unsigned int *cols, const uint8_t *shifts, unsigned int ncols, KeyFunc && kf, const Alloc& alloc, Stats *stats) {
+	typedef rs_keyidx<KeyType, IdxType> P;
 	constexpr unsigned int hist_len = 256;
-	unsigned int cols[wc];
-	unsigned int ncols = 0;
-	KeyType key0;
 
-	// Histograms
-	size_t n_unsorted = n;
+	P *pairs = static_cast<P*>(alloc.allocate(sizeof(P) * n * 2));
+	if (!pairs)
+		return nullptr;
+
+	if (stats) stats->phase_begin(rs_phase::keys, 0);
+	for (size_t i = 0 ; i < n ; ++i) {
+		pairs[i] = P { kf(src[i]), static_cast<IdxType>(i) };
+	}
+	if (stats) stats->phase_end(rs_phase::keys, 0);
+
+	P *psrc = pairs;
+	P *paux = pairs + n;
+	for (unsigned int i = 0 ; i < ncols ; ++i) {
+		unsigned int shift = shifts[cols[i]];
+		if (stats) stats->phase_begin(rs_phase::scatter, shift >> 3);
+		for (size_t j = 0 ; j < n ; ++j) {
+			P p = psrc[j];
+			size_t dst = histogram[(hist_len*cols[i]) + ((p.key >> shift) & 0xFF)]++;
+			paux[dst] = p;
+		}
+		std::swap(psrc, paux);
+		if (stats) stats->phase_end(rs_phase::scatter, shift >> 3);
+	}
+
+	if (stats) stats->phase_begin(rs_phase::gather, 0);
+	rs_gather(src, aux, n, [psrc](size_t i) -> size_t { return psrc[i].idx; });
+	if (stats) stats->phase_end(rs_phase::gather, 0);
+
+	alloc.deallocate(pairs, sizeof(P) * n * 2);
+
+	return aux;
+}
+
+// Histogram pass of rs_sort_main, over n entries of src, which may be one block of a
+// larger input. Adds the counts to the histograms, and returns the number of adjacent
+// entries that are out of order, for pre-sorted detection. Pairs that straddle two
+// blocks are up to the caller.
+template<typename T, typename KeyFunc, typename Hist, typename KeyType=typename std::result_of_t<KeyFunc&&(T)>, typename Prefetch = rs_prefetch_none>
+size_t rs_histogram(const T* RESTRICT src, size_t n, Hist& histogram, KeyFunc && kf, const Prefetch& pf = Prefetch()) {
+	constexpr uint8_t byte_mask = rs_byte_mask_v<KeyFunc, KeyType>;
+	constexpr size_t wc = rs_popcount(byte_mask);
+	constexpr std::array<uint8_t, 8> shift_table = rs_mask_shifts(byte_mask);
+	constexpr unsigned int hist_len = 256;
+	auto src_at = [src](size_t j) -> const T* { return src + j; };
+
+	size_t n_unordered = 0;
 	for (size_t i = 0 ; i < n ; ++i) {
+		pf(i, n, src_at);
 		// pre-sorted detection
-		key0 = kf(src[i]);
-		if ((i < n - 1) && (key0 <= kf(src[i+1]))) {
-			--n_unsorted;
+		KeyType key0 = kf(src[i]);
+		if ((i < n - 1) && !rs_key_in_order<KeyFunc>(key0, kf(src[i+1]))) {
+			++n_unordered;
 		}
-		for (unsigned int j = 0 ; j < wc ; ++j) {
+		rs_unroll<wc>([&](auto j) {
 			++histogram[(hist_len*j) + ((key0 >> shift_table[j]) & 0xFF)];
-		}
+		});
 	}
+	return n_unordered;
+}
+
+// One MSD pass: partitions the n entries of src into dst on the most significant key byte
+// that varies, stably. The 256 buckets are laid out in output order, bucket j being
+// dst[offsets[j]] .. dst[offsets[j+1] - 1], so offsets must hold 257 entries.
+// If no byte varies, everything ends up in the first bucket.
+//
+// Returns the number of adjacent entries of src that are out of order, as rs_histogram.
+template<typename T, typename KeyFunc, typename KeyType=typename std::result_of_t<KeyFunc&&(T)>>
+size_t rs_msd_partition(const T* RESTRICT src, T* RESTRICT dst, size_t n, KeyFunc && kf, size_t *offsets) {
+	constexpr uint8_t byte_mask = rs_byte_mask_v<KeyFunc, KeyType>;
+	constexpr size_t wc = rs_popcount(byte_mask);
+	constexpr std::array<uint8_t, 8> shift_table = rs_mask_shifts(byte_mask);
+	constexpr unsigned int hist_len = 256;
+	constexpr bool descending = rs_descending_v<KeyFunc>;
 
-	if (n_unsorted < 2) {
+	std::fill(offsets, offsets + hist_len + 1, n);
+	offsets[0] = 0;
+	if (n == 0)
+		return 0;
+
+	std::array<size_t, hist_len*wc> histogram{0};
+	size_t n_unordered = rs_histogram(src, n, histogram, kf);
+
+	// Pick the most significant byte that varies.
+	KeyType key0 = kf(*src);
+	unsigned int col = wc;
+	while (col > 0 && histogram[(hist_len*(col - 1)) + ((key0 >> shift_table[col - 1]) & 0xFF)] == n) {
+		--col;
+	}
+	if (col == 0) {
+		std::copy(src, src + n, dst);
+		return n_unordered;
+	}
+	--col;
+	unsigned int shift = shift_table[col];
+
+	// Exclusive scan, from the top bucket down for descending order
+	std::array<size_t, hist_len> pos;
+	size_t a = 0;
+	for (unsigned int j = 0 ; j < hist_len ; ++j) {
+		unsigned int bucket = descending ? hist_len - 1 - j : j;
+		offsets[j] = a;
+		pos[bucket] = a;
+		a += histogram[(hist_len*col) + bucket];
+	}
+
+	for (size_t i = 0 ; i < n ; ++i) {
+		dst[pos[(kf(src[i]) >> shift) & 0xFF]++] = src[i];
+	}
+	return n_unordered;
+}
+
+// The rest of rs_sort_main, given the complete histograms of src, and the number
+// of out of order entries, as accumulated by rs_histogram.
+template<typename T, typename KeyFunc, typename Hist, typename KeyType=typename std::result_of_t<KeyFunc&&(T)>, typename Alloc = rs_alloc_malloc, typename Prefetch = rs_prefetch_none, typename Stats = rs_stats_none>
+T* rs_sort_from_histogram(T* RESTRICT src, T* RESTRICT aux, size_t n, Hist& histogram, size_t n_unordered, KeyFunc && kf, const Alloc& alloc = Alloc(), const Prefetch& pf = Prefetch(), Stats *stats = nullptr) {
+	typedef typename Hist::value_type HVT;
+
+	constexpr uint8_t byte_mask = rs_byte_mask_v<KeyFunc, KeyType>;
+	constexpr size_t wc = rs_popcount(byte_mask);
+	constexpr std::array<uint8_t, 8> shift_table = rs_mask_shifts(byte_mask);
+	constexpr unsigned int hist_len = 256;
+	constexpr bool descending = rs_descending_v<KeyFunc>;
+	unsigned int cols[wc];
+	unsigned int ncols = 0;
+	KeyType key0;
+	auto src_at = [&src](size_t j) -> const T* { return src + j; };
+	rs_sort_info info;
+	info.n = n;
+	info.key_bytes = wc;
+	info.counter_bytes = sizeof(HVT);
+	info.skipped = ((1U << sizeof(KeyType)) - 1) & ~byte_mask;
+
+	if (n_unordered == 0) {
+		info.exit = rs_exit::presorted;
+		if (stats) stats->done(info);
 		return src;
 	}
 
 	// Sample first key to determine if any columns can be skipped
+	if (stats) stats->phase_begin(rs_phase::scan, 0);
 	key0 = kf(*src);
 	for (unsigned int i = 0 ; i < wc ; ++i) {
 		if (histogram[(hist_len*i) + ((key0 >> shift_table[i]) & 0xFF)] != n) {
 			cols[ncols++] = i;
+		} else {
+			info.skipped |= 1U << (shift_table[i] >> 3);
 		}
 	}
+	info.passes = ncols;
 
-	// Calculate offsets (exclusive scan)
+	// Calculate offsets (exclusive scan), from the top bucket down for descending order
 	for (unsigned int i = 0 ; i < ncols ; ++i) {
 		HVT a = 0;
 		for (unsigned int j = 0 ; j < hist_len ; ++j) {
-			HVT b = histogram[(hist_len*cols[i]) + j];
-			histogram[(hist_len*cols[i]) + j] = a;
+			unsigned int bucket = descending ? hist_len - 1 - j : j;
+			HVT b = histogram[(hist_len*cols[i]) + bucket];
+			histogram[(hist_len*cols[i]) + bucket] = a;
 			a += b;
 		}
 	}
+	if (stats) stats->phase_end(rs_phase::scan, 0);
+
+	// Sort (key, index)-pairs and gather the records at the end, if that moves less memory.
+	if constexpr (rs_prefer_indirect<T, rs_keyidx<KeyType, uint32_t>>(SIZE_MAX, wc)) {
+		if (rs_prefer_indirect<T, rs_keyidx<KeyType, uint32_t>>(n, ncols)) {
+			T *res;
+			if (n <= UINT32_MAX) {
+				res = rs_sort_indirect<uint32_t, T, KeyFunc, Hist, KeyType>(src, aux, n, histogram, cols, shift_table.data(), ncols, kf, alloc, stats);
+				info.bytes_moved = n * (sizeof(rs_keyidx<KeyType, uint32_t>) * (ncols + 1) + sizeof(T));
+			} else {
+				res = rs_sort_indirect<uint64_t, T, KeyFunc, Hist, KeyType>(src, aux, n, histogram, cols, shift_table.data(), ncols, kf, alloc, stats);
+				info.bytes_moved = n * (sizeof(rs_keyidx<KeyType, uint64_t>) * (ncols + 1) + sizeof(T));
+			}
+			if (res) {
+				info.indirect = true;
+				if (stats) stats->done(info);
+				return res;
+			}
+		}
+	}
 
 	// Sort
 	for (unsigned int i = 0 ; i < ncols ; ++i) {
+		if (stats) stats->phase_begin(rs_phase::scatter, shift_table[cols[i]] >> 3);
 		for (size_t j = 0 ; j < n ; ++j) {
+			pf(j, n, src_at);
 			auto k = src[j];
 			size_t dst = histogram[(hist_len*cols[i]) + ((kf(k) >> shift_table[cols[i]]) & 0xFF)]++;
 			aux[dst] = std::move(k);
 		}
 		std::swap(src, aux);
+		if (stats) stats->phase_end(rs_phase::scatter, shift_table[cols[i]] >> 3);
 	}
 
+	info.bytes_moved = n * sizeof(T) * ncols;
+	if (stats) stats->done(info);
+
 	return src;
 }
 
+// Element of the cached-key sort, see basic_kdfs::cached.
+template<typename KeyType, typename T>
+struct rs_keyval {
+	KeyType key;
+	T value;
+};
+
+// KDF of the cached-key sort, with the byte mask and order of the KDF the keys came from.
+template<uint8_t Mask, bool Descending>
+struct rs_cached_key {
+	static constexpr uint8_t byte_mask = Mask;
+	static constexpr bool descending = Descending;
+
+	template<typename P>
+	auto operator()(const P& p) const {
+		return p.key;
+	}
+};
+
+// Cached-key sort, called from rs_sort_main with empty histograms. The keys are derived
+// once, in a single pass with prefetching, into (key, entry)-pairs, which are histogrammed
+// as they're written, then sorted with sequential reads only. The entries are finally
+// copied out of the sorted pairs into aux.
+//
+// Returns src if it was already sorted, aux if not, or nullptr if the pair buffer could
+// not be allocated, in which case nothing has been done.
+template<typename T, typename KeyFunc, typename Hist, typename KeyType, typename Alloc, typename Stats>
+T* rs_sort_cached_keys(T* RESTRICT src, T* RESTRICT aux, size_t n, Hist& histogram, KeyFunc && kf, const Alloc& alloc, Stats *stats) {
+	typedef rs_keyval<KeyType, T> P;
+	constexpr uint8_t byte_mask = rs_byte_mask_v<KeyFunc, KeyType>;
+	constexpr size_t wc = rs_popcount(byte_mask);
+	constexpr std::array<uint8_t, 8> shift_table = rs_mask_shifts(byte_mask);
+	constexpr unsigned int hist_len = 256;
+	const rs_prefetch pf;
+	auto src_at = [src](size_t j) -> const T* { return src + j; };
+
+	P *pairs = static_cast<P*>(alloc.allocate(sizeof(P) * n * 2));
+	if (!pairs)
+		return nullptr;
+
+	if (stats) stats->phase_begin(rs_phase::keys, 0);
+	size_t n_unordered = 0;
+	KeyType prev = kf(src[0]);
+	for (size_t i = 0 ; i < n ; ++i) {
+		pf(i, n, src_at);
+		KeyType key = kf(src[i]);
+		n_unordered += !rs_key_in_order<KeyFunc>(prev, key);
+		prev = key;
+		rs_unroll<wc>([&](auto j) {
+			++histogram[(hist_len*j) + ((key >> shift_table[j]) & 0xFF)];
+		});
+		pairs[i] = P { key, src[i] };
+	}
+	if (stats) stats->phase_end(rs_phase::keys, 0);
+
+	T *res = src;
+	if (n_unordered != 0) {
+		P *sorted = rs_sort_from_histogram(pairs, pairs + n, n, histogram, n_unordered, rs_cached_key<byte_mask, rs_descending_v<KeyFunc>>(), alloc, rs_prefetch_none(), stats);
+		if (stats) stats->phase_begin(rs_phase::gather, 0);
+		for (size_t i = 0 ; i < n ; ++i) {
+			aux[i] = sorted[i].value;
+		}
+		if (stats) stats->phase_end(rs_phase::gather, 0);
+		res = aux;
+	} else {
+		rs_sort_info info;
+		info.n = n;
+		info.key_bytes = wc;
+		info.exit = rs_exit::presorted;
+		if (stats) stats->done(info);
+	}
+
+	alloc.deallocate(pairs, sizeof(P) * n * 2);
+	return res;
+}
+
+// 8xW-bit Radix Sort
+//
+// T is the type being sorted.
+// KeyFunc is the KDF.
+// Hist is storage for the histograms, sized to 256*passes*sizeof(counter-type)
+// KeyType is derived from the return value of the KeyFunc (an unsigned integer)
+//
+// Only the bytes of the key in the KDFs byte mask are histogrammed and sorted on, see
+// rs_byte_mask. The number of passes is the number of bytes in the mask.
+//
+// If the KDF asks for it, see rs_descending, the keys are sorted in descending order
+// by reversing the prefix sums. The sort is stable either way.
+//
+// Large records are sorted indirectly, see rs_prefer_indirect, and with KDFs that ask
+// for it, the keys are cached, see basic_kdfs::cached. The result is the same.
+// Alloc is the policy used for the temporary buffer of the indirect and cached-key sorts.
+// Prefetch is the prefetch policy used in the histogram and scatter loops.
+// Stats is an optional statistics/trace hook, see radix_sort_stats.hpp.
+//
+// The work is split in rs_histogram and rs_sort_from_histogram, for callers that
+// build the histograms themselves, e.g while the input is being read.
+//
+template<typename T, typename KeyFunc = decltype(basic_kdfs::kdf<T>), typename Hist, typename KeyType=typename std::result_of_t<KeyFunc&&(T)>, typename Alloc = rs_alloc_malloc, typename Prefetch = rs_prefetch_none, typename Stats = rs_stats_none>
+T* rs_sort_main(T* RESTRICT src, T* RESTRICT aux, size_t n, Hist& histogram, KeyFunc && kf = basic_kdfs::kdf, const Alloc& alloc = Alloc(), const Prefetch& pf = Prefetch(), Stats *stats = nullptr) {
+	static_assert(sizeof(KeyType) <= 8, "KeyType must be 64-bits or less");
+	static_assert(std::is_unsigned<KeyType>(), "KeyType must be unsigned");
+	static_assert(rs_byte_mask_v<KeyFunc, KeyType> != 0, "Key byte mask must not be empty");
+
+	if (n < 2)
+		return src;
+
+	if constexpr (rs_cache_keys_v<KeyFunc>) {
+		T *res = rs_sort_cached_keys<T, KeyFunc, Hist, KeyType>(src, aux, n, histogram, kf, alloc, stats);
+		if (res)
+			return res;
+	}
+
+	// Histograms
+	if (stats) stats->phase_begin(rs_phase::histogram, 0);
+	size_t n_unordered = rs_histogram(src, n, histogram, kf, pf);
+	if (stats) stats->phase_end(rs_phase::histogram, 0);
+
+	return rs_sort_from_histogram(src, aux, n, histogram, n_unordered, kf, alloc, pf, stats);
+}
+
 // This version is for automatically selecting the smallest
 // possible counter data-type for the histograms.
 // Histograms stored on stack (2KiB-16KiB).
-template<typename T, typename KeyFunc = decltype(basic_kdfs::kdf<T>), int passes = sizeof(typename std::result_of_t<KeyFunc&&(T)>)>
-T* radix_sort(T* RESTRICT src, T* RESTRICT aux, size_t n, KeyFunc && kf = basic_kdfs::kdf) {
+// Inputs smaller than rs_small_n are insertion sorted, in place.
+template<typename T, typename KeyFunc = decltype(basic_kdfs::kdf<T>), int passes = rs_popcount(rs_byte_mask_v<KeyFunc, std::result_of_t<KeyFunc&&(T)>>), typename Alloc = rs_alloc_malloc, typename Prefetch = rs_prefetch_none, typename Stats = rs_stats_none>
+T* radix_sort(T* RESTRICT src, T* RESTRICT aux, size_t n, KeyFunc && kf = basic_kdfs::kdf, const Alloc& alloc = Alloc(), const Prefetch& pf = Prefetch(), Stats *stats = nullptr) {
 	if (n < 2) {
 		return src;
+	} else if (n < rs_small_n) {
+		return rs_sort_small(src, n, kf, stats);
 	} else if (n < 256) {
 		std::array<uint8_t,256*passes> histogram{0};
-		return rs_sort_main(src, aux, n, histogram, kf);
+		return rs_sort_main(src, aux, n, histogram, kf, alloc, pf, stats);
 	} else if (n < (1ULL << 16ULL)) {
 		std::array<uint16_t,256*passes> histogram{0};
-		return rs_sort_main(src, aux, n, histogram, kf);
+		return rs_sort_main(src, aux, n, histogram, kf, alloc, pf, stats);
 	} else if (n < (1ULL << 32ULL)) {
 		std::array<uint32_t,256*passes> histogram{0};
-		return rs_sort_main(src, aux, n, histogram, kf);
+		return rs_sort_main(src, aux, n, histogram, kf, alloc, pf, stats);
 	} else {
 		std::array<uint64_t,256*passes> histogram{0};
-		return rs_sort_main(src, aux, n, histogram, kf);
+		return rs_sort_main(src, aux, n, histogram, kf, alloc, pf, stats);
 	}
 }
+
+// Sorts arr, with the auxiliary buffer allocated (and freed) using Alloc.
+// The result is always returned in arr. Returns false if the allocation failed.
+template<typename T, typename KeyFunc = decltype(basic_kdfs::kdf<T>), typename Alloc = rs_alloc_malloc>
+bool radix_sort_alloc(T* arr, size_t n, KeyFunc && kf = basic_kdfs::kdf, const Alloc& alloc = Alloc()) {
+	static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+	if (n < 2)
+		return true;
+
+	T *aux = static_cast<T*>(alloc.allocate(sizeof(T) * n));
+	if (!aux)
+		return false;
+
+	T *res = radix_sort(arr, aux, n, kf, alloc);
+	if (res != arr)
+		std::memcpy(arr, res, sizeof(T) * n);
+
+	alloc.deallocate(aux, sizeof(T) * n);
+	return true;
+}
+
+// Reusable sorter, keeping its auxiliary buffer allocated between calls.
+// The buffer is grown on demand using Alloc.
+template<typename T, typename Alloc = rs_alloc_malloc>
+class radix_sorter {
+	static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+public:
+	explicit radix_sorter(const Alloc& a = Alloc()) : alloc(a) { }
+	radix_sorter(const radix_sorter&) = delete;
+	radix_sorter& operator=(const radix_sorter&) = delete;
+	~radix_sorter() {
+		alloc.deallocate(aux, capacity * sizeof(T));
+	}
+
+	// Make sure the auxiliary buffer can hold n entries. Returns false on allocation failure.
+	bool reserve(size_t n) {
+		if (n <= capacity)
+			return true;
+		T *mem = static_cast<T*>(alloc.allocate(n * sizeof(T)));
+		if (!mem)
+			return false;
+		alloc.deallocate(aux, capacity * sizeof(T));
+		aux = mem;
+		capacity = n;
+		return true;
+	}
+
+	// Sort src, returning a pointer to the result, which is either src or the internal
+	// buffer. The latter is only valid until the next call. Returns nullptr on allocation failure.
+	template<typename KeyFunc = decltype(basic_kdfs::kdf<T>)>
+	T* sort(T* src, size_t n, KeyFunc && kf = basic_kdfs::kdf) {
+		if (!reserve(n))
+			return nullptr;
+		return radix_sort(src, aux, n, kf, alloc);
+	}
+
+private:
+	Alloc alloc;
+	T *aux = nullptr;
+	size_t capacity = 0;
+};
@@ -0,0 +1,343 @@
+/*
+	Adaptive sorting: picking the algorithm from a sample of the keys.
+
+	radix_sort_adaptive samples at most one in 1024 keys, evenly spaced, up to rs_adaptive_sample_n,
+	and estimates the key range, the number of distinct keys, and how sorted the input is.
+	It then dispatches to one of:
+
+		lsd        - radix_sort, if the sample is sorted, since it then checks the whole input.
+		counting   - a counting sort, if the key range is narrow.
+		few_keys   - a counting sort over the distinct keys, if there are few of them.
+		comparison - std::stable_sort, if the input is nearly, but not quite, sorted.
+		bitmap     - a bitmap sort, for distinct unsigned integers over a moderate range.
+		msd        - one MSD pass, then LSD radix sort of each bucket, for wide keys in large inputs.
+		lsd        - radix_sort, otherwise.
+
+	in that order of precedence.
+
+	The counting and bitmap sorts first check the exact key range, the bitmap sort that the
+	keys really are distinct, and the few_keys sort that they really are few, falling back to
+	radix_sort if the sample was misleading.
+
+	The choice, and the sample estimates, are reported through the stats hook, in rs_sort_info.
+
+	See https://github.com/eloj/radix-sorting#adaptive
+*/
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cinttypes>
+
+#include "radix_sort.hpp"
+
+// Evenly spaced sample of the keys of src. n must be at least two.
+template<typename T, typename KeyFunc, typename KeyType=typename std::result_of_t<KeyFunc&&(T)>>
+rs_sample_info rs_sample_keys(const T* src, size_t n, KeyFunc && kf) {
+	std::array<KeyType, rs_adaptive_sample_n> keys {};
+	rs_sample_info sample;
+	sample.n = std::min(n, std::clamp<size_t>(n >> 10, 2, rs_adaptive_sample_n));
+	size_t stride = n / sample.n;
+
+	for (size_t i = 0 ; i < sample.n ; ++i) {
+		keys[i] = kf(src[i * stride]);
+		if (i > 0 && !rs_key_in_order<KeyFunc>(keys[i - 1], keys[i]))
+			++sample.unordered;
+	}
+
+	std::sort(keys.begin(), keys.begin() + sample.n);
+	sample.distinct = 1;
+	for (size_t i = 1 ; i < sample.n ; ++i) {
+		sample.distinct += keys[i] != keys[i - 1];
+	}
+	sample.min = keys[0];
+	sample.max = keys[sample.n - 1];
+
+	return sample;
+}
+
+// True if the keys are the values themselves, so that a bitmap of the keys is the sorted output.
+template<typename T, typename KeyFunc>
+constexpr bool rs_bitmap_sortable = std::is_same_v<std::decay_t<KeyFunc>, basic_kdfs::kdf_object> && std::is_integral_v<T> && std::is_unsigned_v<T> && !std::is_same_v<T, bool>;
+
+template<typename T, typename KeyFunc>
+rs_strategy rs_choose_strategy(size_t n, const rs_sample_info& sample) {
+	typedef typename std::result_of_t<KeyFunc&&(T)> KeyType;
+	uint64_t range = sample.max - sample.min;
+
+	// radix_sort checks exactly, and returns after one read, if the input is sorted.
+	if (sample.unordered == 0)
+		return rs_strategy::lsd;
+	if (range < rs_counting_max_range)
+		return rs_strategy::counting;
+	// Each key seen four times on average suggests that few keys were missed.
+	if (sample.distinct <= rs_few_keys_max / 2 && sample.distinct * 4 <= sample.n)
+		return rs_strategy::few_keys;
+	if (sample.unordered * rs_nearly_sorted_div <= sample.n)
+		return rs_strategy::comparison;
+	if constexpr (rs_bitmap_sortable<T, KeyFunc>) {
+		if (sample.distinct == sample.n && range < rs_bitmap_max_range && range / rs_bitmap_max_sparsity < n)
+			return rs_strategy::bitmap;
+	}
+	// Number of bytes up to and including the most significant one that varies in the sample.
+	unsigned int live_bytes = 0;
+	for (uint64_t diff = sample.min ^ sample.max ; diff ; diff >>= 8) {
+		++live_bytes;
+	}
+	if (live_bytes >= 3 && rs_popcount(rs_byte_mask_v<KeyFunc, KeyType>) >= 3 && n * sizeof(T) >= rs_msd_min_bytes)
+		return rs_strategy::msd;
+	return rs_strategy::lsd;
+}
+
+// Exact minimum and maximum key.
+template<typename T, typename KeyFunc, typename KeyType>
+void rs_key_range(const T* src, size_t n, KeyFunc && kf, KeyType *lo, KeyType *hi) {
+	KeyType mi = kf(*src);
+	KeyType ma = mi;
+	for (size_t i = 1 ; i < n ; ++i) {
+		KeyType key = kf(src[i]);
+		mi = std::min(mi, key);
+		ma = std::max(ma, key);
+	}
+	*lo = mi;
+	*hi = ma;
+}
+
+// Stable counting sort of src into aux, of keys in [lo, lo + range). Returns aux, or null
+// if the counters could not be allocated.
+template<typename C, typename T, typename KeyFunc, typename KeyType, typename Alloc, typename Stats>
+T* rs_sort_counting(const T* RESTRICT src, T* RESTRICT aux, size_t n, KeyFunc && kf, KeyType lo, size_t range, const Alloc& alloc, Stats *stats) {
+	constexpr bool descending = rs_descending_v<KeyFunc>;
+	C *counts = static_cast<C*>(alloc.allocate(sizeof(C) * range));
+	if (!counts)
+		return nullptr;
+	std::fill(counts, counts + range, 0);
+
+	if (stats) stats->phase_begin(rs_phase::histogram, 0);
+	for (size_t i = 0 ; i < n ; ++i) {
+		++counts[kf(src[i]) - lo];
+	}
+	if (stats) stats->phase_end(rs_phase::histogram, 0);
+
+	// Exclusive scan, from the top down for descending order
+	C a = 0;
+	for (size_t j = 0 ; j < range ; ++j) {
+		size_t bucket = descending ? range - 1 - j : j;
+		C b = counts[bucket];
+		counts[bucket] = a;
+		a += b;
+	}
+
+	if (stats) stats->phase_begin(rs_phase::scatter, 0);
+	for (size_t i = 0 ; i < n ; ++i) {
+		aux[counts[kf(src[i]) - lo]++] = src[i];
+	}
+	if (stats) stats->phase_end(rs_phase::scatter, 0);
+
+	alloc.deallocate(counts, sizeof(C) * range);
+	return aux;
+}
+
+// Slots in the hash table of rs_sort_few_keys, a power of two at most half full.
+constexpr size_t rs_few_keys_slots = [] {
+	size_t slots = 1;
+	while (slots < 2 * rs_few_keys_max) {
+		slots <<= 1;
+	}
+	return slots;
+}();
+
+// Slot of key in the table of rs_sort_few_keys: the first one, probing linearly from its
+// Fibonacci hash, that holds the key, or is free, with a count of zero.
+template<typename KeyType>
+inline size_t rs_few_keys_slot(const KeyType *keys, const size_t *counts, KeyType key) {
+	constexpr unsigned int bits = __builtin_ctzll(rs_few_keys_slots);
+	size_t s = (uint64_t(key) * 0x9E3779B97F4A7C15ULL) >> (64 - bits);
+	while (counts[s] && keys[s] != key) {
+		s = (s + 1) & (rs_few_keys_slots - 1);
+	}
+	return s;
+}
+
+// Stable counting sort of src into aux over its distinct keys, which are counted in an
+// open-addressing hash table. The distinct keys are then sorted, and each entry scattered
+// to the running offset of its key, in one pass. Returns aux, or null if there are more
+// than rs_few_keys_max distinct keys, which it stops counting at.
+template<typename T, typename KeyFunc, typename Stats, typename KeyType=typename std::result_of_t<KeyFunc&&(T)>>
+T* rs_sort_few_keys(const T* RESTRICT src, T* RESTRICT aux, size_t n, KeyFunc && kf, Stats *stats) {
+	std::array<KeyType, rs_few_keys_slots> keys;
+	std::array<size_t, rs_few_keys_slots> counts{0};
+	std::array<size_t, rs_few_keys_max> order;
+	size_t distinct = 0;
+
+	if (stats) stats->phase_begin(rs_phase::histogram, 0);
+	for (size_t i = 0 ; i < n ; ++i) {
+		KeyType key = kf(src[i]);
+		size_t s = rs_few_keys_slot(keys.data(), counts.data(), key);
+		if (counts[s] == 0) {
+			if (distinct == rs_few_keys_max) {
+				if (stats) stats->phase_end(rs_phase::histogram, 0);
+				return nullptr;
+			}
+			keys[s] = key;
+			order[distinct++] = s;
+		}
+		++counts[s];
+	}
+	if (stats) stats->phase_end(rs_phase::histogram, 0);
+
+	// Exclusive scan over the keys in order. The counts are kept, as they mark the used slots.
+	std::sort(order.begin(), order.begin() + distinct, [&keys](size_t a, size_t b) {
+		return rs_descending_v<KeyFunc> ? keys[b] < keys[a] : keys[a] < keys[b];
+	});
+	std::array<size_t, rs_few_keys_slots> pos;
+	size_t a = 0;
+	for (size_t j = 0 ; j < distinct ; ++j) {
+		pos[order[j]] = a;
+		a += counts[order[j]];
+	}
+
+	if (stats) stats->phase_begin(rs_phase::scatter, 0);
+	for (size_t i = 0 ; i < n ; ++i) {
+		aux[pos[rs_few_keys_slot(keys.data(), counts.data(), kf(src[i]))]++] = src[i];
+	}
+	if (stats) stats->phase_end(rs_phase::scatter, 0);
+
+	return aux;
+}
+
+// Bitmap sort of the unsigned integers of src, in [lo, lo + range), in place. Returns false,
+// with src untouched, if a duplicate was found, or the bitmap could not be allocated.
+template<typename T, typename Alloc, typename Stats>
+bool rs_sort_bitmap(T* src, size_t n, T lo, uint64_t range, const Alloc& alloc, Stats *stats) {
+	size_t words = (range + 63) >> 6;
+	uint64_t *bitmap = static_cast<uint64_t*>(alloc.allocate(sizeof(uint64_t) * words));
+	if (!bitmap)
+		return false;
+	std::fill(bitmap, bitmap + words, 0);
+
+	if (stats) stats->phase_begin(rs_phase::histogram, 0);
+	uint64_t dup = 0;
+	for (size_t i = 0 ; i < n ; ++i) {
+		uint64_t v = src[i] - lo;
+		uint64_t bit = 1ULL << (v & 63);
+		dup |= bitmap[v >> 6] & bit;
+		bitmap[v >> 6] |= bit;
+	}
+	if (stats) stats->phase_end(rs_phase::histogram, 0);
+
+	if (!dup) {
+		if (stats) stats->phase_begin(rs_phase::scatter, 0);
+		size_t j = 0;
+		for (size_t w = 0 ; w < words ; ++w) {
+			for (uint64_t bits = bitmap[w] ; bits ; bits &= bits - 1) {
+				src[j++] = T(lo + (w << 6) + __builtin_ctzll(bits));
+			}
+		}
+		if (stats) stats->phase_end(rs_phase::scatter, 0);
+	}
+
+	alloc.deallocate(bitmap, sizeof(uint64_t) * words);
+	return !dup;
+}
+
+// One MSD pass from src to aux, then each bucket radix sorted in cache. Returns a pointer
+// to the sorted entries, which are in aux, unless src was already sorted.
+template<typename T, typename KeyFunc, typename Alloc>
+T* rs_sort_msd(T* RESTRICT src, T* RESTRICT aux, size_t n, KeyFunc && kf, const Alloc& alloc) {
+	std::array<size_t, 257> offsets;
+	if (rs_msd_partition(src, aux, n, kf, offsets.data()) == 0)
+		return src;
+	for (unsigned int j = 0 ; j < 256 ; ++j) {
+		size_t len = offsets[j + 1] - offsets[j];
+		T *res = radix_sort(aux + offsets[j], src + offsets[j], len, kf, alloc);
+		if (res != aux + offsets[j])
+			std::copy(res, res + len, aux + offsets[j]);
+	}
+	return aux;
+}
+
+// Forwards to the caller's hook, adding the strategy and sample to the summary.
+template<typename Stats>
+struct rs_stats_strategy {
+	Stats *stats;
+	rs_strategy strategy;
+	rs_sample_info sample;
+
+	void phase_begin(rs_phase phase, unsigned int col) { stats->phase_begin(phase, col); }
+	void phase_end(rs_phase phase, unsigned int col) { stats->phase_end(phase, col); }
+	void done(const rs_sort_info& info) {
+		rs_sort_info res = info;
+		res.strategy = strategy;
+		res.sample = sample;
+		stats->done(res);
+	}
+};
+
+// Sorts src, like radix_sort, with the algorithm picked from a sample of the keys, see above.
+// Returns a pointer to the sorted entries, which are in either src or aux. The sort is stable.
+//
+// The bitmap sort is only considered with the default KDF, basic_kdfs::kdf_object, on unsigned
+// integers, for which the sorted values can be recreated from the bitmap.
+template<typename T, typename KeyFunc = basic_kdfs::kdf_object, typename Alloc = rs_alloc_malloc, typename Prefetch = rs_prefetch_none, typename Stats = rs_stats_none>
+T* radix_sort_adaptive(T* RESTRICT src, T* RESTRICT aux, size_t n, KeyFunc && kf = KeyFunc(), const Alloc& alloc = Alloc(), const Prefetch& pf = Prefetch(), Stats *stats = nullptr) {
+	typedef typename std::result_of_t<KeyFunc&&(T)> KeyType;
+
+	if (n < rs_adaptive_min_n)
+		return radix_sort(src, aux, n, kf, alloc, pf, stats);
+
+	if (stats) stats->phase_begin(rs_phase::sample, 0);
+	rs_sample_info sample = rs_sample_keys(src, n, kf);
+	rs_strategy strategy = rs_choose_strategy<T, KeyFunc>(n, sample);
+	if (stats) stats->phase_end(rs_phase::sample, 0);
+
+	rs_sort_info info;
+	info.n = n;
+	info.key_bytes = sizeof(KeyType);
+	info.passes = 1;
+	info.bytes_moved = n * sizeof(T);
+	info.strategy = strategy;
+	info.sample = sample;
+
+	T *res = nullptr;
+	if (strategy == rs_strategy::comparison) {
+		std::stable_sort(src, src + n, [&kf](const T& a, const T& b) {
+			return rs_descending_v<KeyFunc> ? kf(b) < kf(a) : kf(a) < kf(b);
+		});
+		info.passes = 0;
+		res = src;
+	} else if (strategy == rs_strategy::msd) {
+		res = rs_sort_msd(src, aux, n, kf, alloc);
+		info.exit = res == src ? rs_exit::presorted : rs_exit::sorted;
+	} else if (strategy == rs_strategy::few_keys) {
+		info.counter_bytes = sizeof(size_t);
+		res = rs_sort_few_keys(src, aux, n, kf, stats);
+	} else if (strategy == rs_strategy::counting || strategy == rs_strategy::bitmap) {
+		KeyType lo, hi;
+		rs_key_range(src, n, kf, &lo, &hi);
+		// The span, hi - lo, is compared before adding one, which wraps for full range 64-bit keys.
+		uint64_t span = uint64_t(hi - lo);
+		uint64_t range = span + 1;
+		if (strategy == rs_strategy::counting && span < rs_counting_max_range) {
+			if (n <= UINT32_MAX) {
+				info.counter_bytes = sizeof(uint32_t);
+				res = rs_sort_counting<uint32_t>(src, aux, n, kf, lo, range, alloc, stats);
+			} else {
+				info.counter_bytes = sizeof(uint64_t);
+				res = rs_sort_counting<uint64_t>(src, aux, n, kf, lo, range, alloc, stats);
+			}
+		} else if constexpr (rs_bitmap_sortable<T, KeyFunc>) {
+			if (strategy == rs_strategy::bitmap && span < rs_bitmap_max_range && rs_sort_bitmap(src, n, T(lo), range, alloc, stats))
+				res = src;
+		}
+	}
+
+	if (res) {
+		if (stats) stats->done(info);
+		return res;
+	}
+
+	// Plain LSD, or the fallback if the sample was misleading.
+	rs_stats_strategy<Stats> hook { stats, rs_strategy::lsd, sample };
+	return radix_sort(src, aux, n, kf, alloc, pf, stats ? &hook : nullptr);
+}
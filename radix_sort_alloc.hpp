@@ -0,0 +1,114 @@
+/*
+	Allocation policies for auxiliary buffers.
+
+	A policy is an object with the members:
+
+		void* allocate(size_t bytes) const; // returns nullptr on failure
+		void deallocate(void *mem, size_t bytes) const;
+
+	The scatter passes of a radix sort write all over the auxiliary buffer, so backing
+	it with huge pages can save a lot of TLB misses on large inputs.
+
+	See https://github.com/eloj/radix-sorting#cpp-implementation
+*/
+#pragma once
+
+#include <cstdlib>
+#include <cstddef>
+
+#if __has_include(<sys/mman.h>)
+#include <sys/mman.h> // for mmap, madvise
+#define RS_HAVE_MMAN 1
+#endif
+
+constexpr size_t rs_huge_page_size = 1UL << 21;
+constexpr size_t rs_page_size = 1UL << 12;
+
+// Plain malloc.
+struct rs_alloc_malloc {
+	void* allocate(size_t bytes) const {
+		return malloc(bytes);
+	}
+	void deallocate(void *mem, size_t) const {
+		free(mem);
+	}
+};
+
+#ifdef RS_HAVE_MMAN
+// Huge page aligned posix_memalign, with a request for transparent huge pages.
+struct rs_alloc_thp {
+	void* allocate(size_t bytes) const {
+		void *mem = nullptr;
+		if (posix_memalign(&mem, rs_huge_page_size, bytes) != 0)
+			return nullptr;
+#ifdef MADV_HUGEPAGE
+		madvise(mem, bytes, MADV_HUGEPAGE);
+#endif
+		return mem;
+	}
+	void deallocate(void *mem, size_t) const {
+		free(mem);
+	}
+};
+
+// Anonymous mmap. With huge_tlb, explicit huge pages (MAP_HUGETLB) are tried first,
+// falling back to a regular mapping with a request for transparent huge pages if
+// none are available. With populate, the mapping is pre-faulted (MAP_POPULATE).
+//
+// The huge page mapping must not use MAP_NORESERVE, or it will "succeed" even if
+// the huge page pool is empty, and fault with SIGBUS on first touch instead.
+template<bool huge_tlb, bool populate = false>
+struct rs_alloc_mmap {
+	static size_t map_size(size_t bytes) {
+		return huge_tlb ? (bytes + rs_huge_page_size - 1) & ~(rs_huge_page_size - 1) : bytes;
+	}
+
+	void* allocate(size_t bytes) const {
+		int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+		if (populate)
+			flags |= MAP_POPULATE;
+		size_t len = map_size(bytes);
+		void *mem = MAP_FAILED;
+#ifdef MAP_HUGETLB
+		if (huge_tlb)
+			mem = mmap(nullptr, len, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+#endif
+		if (mem == MAP_FAILED) {
+			mem = mmap(nullptr, len, PROT_READ | PROT_WRITE, flags | MAP_NORESERVE, -1, 0);
+			if (mem == MAP_FAILED)
+				return nullptr;
+#ifdef MADV_HUGEPAGE
+			if (huge_tlb)
+				madvise(mem, len, MADV_HUGEPAGE);
+#endif
+		}
+		return mem;
+	}
+	void deallocate(void *mem, size_t bytes) const {
+		if (mem)
+			munmap(mem, map_size(bytes));
+	}
+};
+
+using rs_alloc_hugetlb = rs_alloc_mmap<true>;
+#endif
+
+// Wraps another policy, touching every page of a new allocation so that the
+// page-faults are taken up front rather than during the first scatter pass.
+template<typename Alloc>
+struct rs_alloc_prefault {
+	Alloc base;
+
+	void* allocate(size_t bytes) const {
+		char *mem = static_cast<char*>(base.allocate(bytes));
+		if (mem) {
+			for (size_t i = 0 ; i < bytes ; i += rs_page_size) {
+				mem[i] = 0;
+			}
+		}
+		return mem;
+	}
+	void deallocate(void *mem, size_t bytes) const {
+		base.deallocate(mem, bytes);
+	}
+};
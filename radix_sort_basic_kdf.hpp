@@ -6,6 +6,7 @@
 
 #include <type_traits>
 #include <algorithm>
+#include <cinttypes>
 
 namespace basic_kdfs {
 
@@ -45,4 +46,117 @@ kdf(const T& value) {
 	return local ^ (-(local >> 63UL) | (1UL << 63UL));
 }
 
+// The basic KDFs as a function object. Classes that store their KDF should default to this,
+// since a stored function pointer is called indirectly, and the calls can't be inlined.
+struct kdf_object {
+	template<typename T>
+	auto operator()(const T& value) const {
+		return kdf<T>(value);
+	}
+};
+
+// Let the KDF wrappers below keep the properties of the KDF they wrap.
+template<typename KeyFunc, typename = void>
+struct inherit_byte_mask { };
+
+template<typename KeyFunc>
+struct inherit_byte_mask<KeyFunc, std::void_t<decltype(KeyFunc::byte_mask)>> {
+	static constexpr uint8_t byte_mask = KeyFunc::byte_mask;
+};
+
+template<typename KeyFunc, typename = void>
+struct inherit_descending { };
+
+template<typename KeyFunc>
+struct inherit_descending<KeyFunc, std::void_t<decltype(KeyFunc::descending)>> {
+	static constexpr bool descending = KeyFunc::descending;
+};
+
+template<typename KeyFunc, typename = void>
+struct inherit_cache_keys { };
+
+template<typename KeyFunc>
+struct inherit_cache_keys<KeyFunc, std::void_t<decltype(KeyFunc::cache_keys)>> {
+	static constexpr bool cache_keys = KeyFunc::cache_keys;
+};
+
+// Wraps a KDF, declaring that only the bytes of the key set in Mask (bit i = byte i, from the LSB)
+// can vary between keys. The other bytes must be the same for all keys, e.g always zero.
+template<uint8_t Mask, typename KeyFunc>
+struct masked_kdf : inherit_descending<KeyFunc>, inherit_cache_keys<KeyFunc> {
+	static constexpr uint8_t byte_mask = Mask;
+	KeyFunc kf;
+
+	template<typename T>
+	auto operator()(const T& value) const {
+		return kf(value);
+	}
+};
+
+// E.g with_byte_mask<0x1F>(kdf<uint64_t>) for 40-bit keys in an uint64_t.
+template<uint8_t Mask, typename KeyFunc>
+masked_kdf<Mask, std::decay_t<KeyFunc>> with_byte_mask(KeyFunc && kf) {
+	return { {}, {}, kf };
+}
+
+// Wraps a KDF, asking for the keys to be sorted in descending order. Unlike complementing
+// the key in the KDF, this costs nothing per key; the sort reverses its prefix sums instead.
+// The sort is stable, i.e like-keys keep their order from the input.
+template<typename KeyFunc>
+struct descending_kdf : inherit_byte_mask<KeyFunc>, inherit_cache_keys<KeyFunc> {
+	static constexpr bool descending = true;
+	KeyFunc kf;
+
+	template<typename T>
+	auto operator()(const T& value) const {
+		return kf(value);
+	}
+};
+
+// E.g descending(kdf<float>)
+template<typename KeyFunc>
+descending_kdf<std::decay_t<KeyFunc>> descending(KeyFunc && kf) {
+	return { {}, {}, kf };
+}
+
+// Wraps a KDF, asking for each key to be derived only once, into a buffer of (key, entry)-pairs,
+// which are then sorted instead of the entries. For KDFs that are expensive, typically because they
+// follow a pointer: otherwise every pass would take a cache miss per entry.
+template<typename KeyFunc>
+struct cached_kdf : inherit_byte_mask<KeyFunc>, inherit_descending<KeyFunc> {
+	static constexpr bool cache_keys = true;
+	KeyFunc kf;
+
+	template<typename T>
+	auto operator()(const T& value) const {
+		return kf(value);
+	}
+};
+
+// E.g cached([](const rec* r) { return r->key; })
+template<typename KeyFunc>
+cached_kdf<std::decay_t<KeyFunc>> cached(KeyFunc && kf) {
+	return { {}, {}, kf };
+}
+
 } // namespace
+
+// True if the KDF asks for descending order, see basic_kdfs::descending.
+template<typename KeyFunc, typename = void>
+struct rs_descending : std::false_type { };
+
+template<typename KeyFunc>
+struct rs_descending<KeyFunc, std::void_t<decltype(KeyFunc::descending)>> : std::bool_constant<KeyFunc::descending> { };
+
+template<typename KeyFunc>
+constexpr bool rs_descending_v = rs_descending<std::decay_t<KeyFunc>>::value;
+
+// True if the KDF asks for the keys to be cached, see basic_kdfs::cached.
+template<typename KeyFunc, typename = void>
+struct rs_cache_keys : std::false_type { };
+
+template<typename KeyFunc>
+struct rs_cache_keys<KeyFunc, std::void_t<decltype(KeyFunc::cache_keys)>> : std::bool_constant<KeyFunc::cache_keys> { };
+
+template<typename KeyFunc>
+constexpr bool rs_cache_keys_v = rs_cache_keys<std::decay_t<KeyFunc>>::value;
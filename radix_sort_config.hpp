@@ -0,0 +1,172 @@
+/*
+	Tunable thresholds and strategy parameters.
+
+	The defaults are reasonable guesses. Running `make tune` benchmarks the local
+	machine and writes radix_sort_tuning.hpp, which, if found on the include path,
+	overrides them. Any value can also be overridden with -D on the command line.
+
+	See https://github.com/eloj/radix-sorting#tuning
+*/
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+#if __has_include("radix_sort_tuning.hpp")
+#include "radix_sort_tuning.hpp"
+#endif
+
+// Below this many entries radix_sort uses an insertion sort.
+#ifndef RS_TUNE_SMALL_N
+#define RS_TUNE_SMALL_N 32
+#endif
+
+// Minimum number of entries to consider an indirect sort.
+#ifndef RS_TUNE_INDIRECT_MIN_N
+#define RS_TUNE_INDIRECT_MIN_N 1024
+#endif
+
+// Cost of the random reads in the gather of an indirect sort, relative
+// to the sequential memory traffic of a sorting pass, per byte.
+#ifndef RS_TUNE_GATHER_COST
+#define RS_TUNE_GATHER_COST 2.0
+#endif
+
+// Default distance of rs_prefetch.
+#ifndef RS_TUNE_PREFETCH_DISTANCE
+#define RS_TUNE_PREFETCH_DISTANCE 16
+#endif
+
+// Minimum number of entries per thread for multi-threaded routines.
+#ifndef RS_TUNE_PARALLEL_MIN_N
+#define RS_TUNE_PARALLEL_MIN_N (1UL << 16)
+#endif
+
+// Default number of threads for multi-threaded routines. Zero means all hardware threads.
+#ifndef RS_TUNE_THREADS
+#define RS_TUNE_THREADS 0
+#endif
+
+// Number of entries sorted together by the segmented sort. Sized to keep a batch,
+// and its (key, index)-pairs, in the L2 cache.
+#ifndef RS_TUNE_SEGMENT_BATCH_N
+#define RS_TUNE_SEGMENT_BATCH_N (1UL << 14)
+#endif
+
+// Segments at least this long are sorted on their own by the segmented sort.
+#ifndef RS_TUNE_SEGMENT_MAX_N
+#define RS_TUNE_SEGMENT_MAX_N 64
+#endif
+
+// Size of the reads of radix_sort_fd. Each block is histogrammed as soon as it's read,
+// so it should fit in the L2 cache.
+#ifndef RS_TUNE_FILE_BLOCK_BYTES
+#define RS_TUNE_FILE_BLOCK_BYTES (1UL << 18)
+#endif
+
+// Below this many entries radix_sort_adaptive goes straight to radix_sort, without sampling.
+#ifndef RS_TUNE_ADAPTIVE_MIN_N
+#define RS_TUNE_ADAPTIVE_MIN_N (1UL << 16)
+#endif
+
+// Maximum number of keys sampled by radix_sort_adaptive. At most one in 1024 keys is sampled.
+#ifndef RS_TUNE_ADAPTIVE_SAMPLE_N
+#define RS_TUNE_ADAPTIVE_SAMPLE_N 1024
+#endif
+
+// Input with at most one in this many sampled pairs out of order is considered nearly sorted,
+// and is sorted with std::stable_sort. The LSD passes are slow on nearly sorted input, as all
+// the buckets are written in lockstep, at addresses that tend to map to the same cache sets.
+#ifndef RS_TUNE_NEARLY_SORTED_DIV
+#define RS_TUNE_NEARLY_SORTED_DIV 32
+#endif
+
+// Largest key range, max - min + 1, that is counting sorted.
+#ifndef RS_TUNE_COUNTING_MAX_RANGE
+#define RS_TUNE_COUNTING_MAX_RANGE (1UL << 16)
+#endif
+
+// Largest number of distinct keys that is counting sorted by hashing the keys, for inputs
+// with a wide key range but few distinct keys. Above this, the sort falls back to radix_sort.
+#ifndef RS_TUNE_FEW_KEYS_MAX
+#define RS_TUNE_FEW_KEYS_MAX 256
+#endif
+
+// Largest key range that is bitmap sorted, if the keys appear to be distinct, and the range
+// is at most RS_TUNE_BITMAP_MAX_SPARSITY times the number of keys.
+#ifndef RS_TUNE_BITMAP_MAX_RANGE
+#define RS_TUNE_BITMAP_MAX_RANGE (1UL << 24)
+#endif
+
+#ifndef RS_TUNE_BITMAP_MAX_SPARSITY
+#define RS_TUNE_BITMAP_MAX_SPARSITY 16
+#endif
+
+// Inputs of at least this many bytes, with at least three varying key bytes, are sorted by
+// one MSD pass followed by LSD sorts of the, hopefully cache-sized, buckets.
+#ifndef RS_TUNE_MSD_MIN_BYTES
+#define RS_TUNE_MSD_MIN_BYTES (1UL << 25)
+#endif
+
+// Size of the blocks that radix_sort_inplace buffers and permutes. Each thread holds one block
+// per bucket, plus as much again for sorting small buckets, so 256 blocks should fit in the L2 cache.
+#ifndef RS_TUNE_INPLACE_BLOCK_BYTES
+#define RS_TUNE_INPLACE_BLOCK_BYTES (1UL << 10)
+#endif
+
+// Buckets of radix_sort_msd_parallel of at most this many entries are sorted with radix_sort,
+// larger ones are split by another MSD pass, into tasks that other threads can steal.
+#ifndef RS_TUNE_MSD_TASK_N
+#define RS_TUNE_MSD_TASK_N (1UL << 16)
+#endif
+
+// Tile size of radix_sort_onesweep. Each tile is counted and then scattered while in the
+// cache, and costs a look-back over 256 buckets, and 2KiB of status, per pass.
+#ifndef RS_TUNE_ONESWEEP_TILE_N
+#define RS_TUNE_ONESWEEP_TILE_N (1UL << 14)
+#endif
+
+// radix_partition gathers entries in cache line buffers, which are streamed out past the
+// cache, for at least this many partition bits and entries. Below that the buffering costs
+// more than it saves, and the output is better left in the cache.
+#ifndef RS_TUNE_PARTITION_WC_MIN_BITS
+#define RS_TUNE_PARTITION_WC_MIN_BITS 8
+#endif
+
+#ifndef RS_TUNE_PARTITION_WC_MIN_N
+#define RS_TUNE_PARTITION_WC_MIN_N (1UL << 18)
+#endif
+
+constexpr size_t rs_cacheline = 64;
+constexpr size_t rs_small_n = RS_TUNE_SMALL_N;
+constexpr size_t rs_indirect_min_n = RS_TUNE_INDIRECT_MIN_N;
+constexpr double rs_gather_cost = RS_TUNE_GATHER_COST;
+constexpr size_t rs_prefetch_distance = RS_TUNE_PREFETCH_DISTANCE;
+constexpr size_t rs_parallel_min_n = RS_TUNE_PARALLEL_MIN_N;
+constexpr unsigned int rs_threads = RS_TUNE_THREADS;
+constexpr size_t rs_segment_batch_n = RS_TUNE_SEGMENT_BATCH_N;
+constexpr size_t rs_segment_max_n = RS_TUNE_SEGMENT_MAX_N;
+constexpr size_t rs_file_block_bytes = RS_TUNE_FILE_BLOCK_BYTES;
+constexpr size_t rs_adaptive_min_n = RS_TUNE_ADAPTIVE_MIN_N;
+constexpr size_t rs_adaptive_sample_n = RS_TUNE_ADAPTIVE_SAMPLE_N;
+constexpr size_t rs_nearly_sorted_div = RS_TUNE_NEARLY_SORTED_DIV;
+constexpr uint64_t rs_counting_max_range = RS_TUNE_COUNTING_MAX_RANGE;
+constexpr size_t rs_few_keys_max = RS_TUNE_FEW_KEYS_MAX;
+constexpr uint64_t rs_bitmap_max_range = RS_TUNE_BITMAP_MAX_RANGE;
+constexpr uint64_t rs_bitmap_max_sparsity = RS_TUNE_BITMAP_MAX_SPARSITY;
+constexpr size_t rs_msd_min_bytes = RS_TUNE_MSD_MIN_BYTES;
+constexpr size_t rs_inplace_block_bytes = RS_TUNE_INPLACE_BLOCK_BYTES;
+constexpr size_t rs_msd_task_n = RS_TUNE_MSD_TASK_N;
+constexpr size_t rs_onesweep_tile_n = RS_TUNE_ONESWEEP_TILE_N;
+constexpr unsigned int rs_partition_wc_min_bits = RS_TUNE_PARTITION_WC_MIN_BITS;
+constexpr size_t rs_partition_wc_min_n = RS_TUNE_PARTITION_WC_MIN_N;
+
+// Number of threads to use for n entries, given a requested count, zero meaning the default.
+inline unsigned int rs_num_threads(unsigned int requested, size_t n) {
+	unsigned int threads = requested ? requested : rs_threads;
+	if (threads == 0)
+		threads = std::max(1U, std::thread::hardware_concurrency());
+	return std::min<size_t>(threads, std::max<size_t>(1, n / rs_parallel_min_n));
+}
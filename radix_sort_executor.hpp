@@ -0,0 +1,129 @@
+/*
+	Executors and work-stealing task scheduling for the parallel sorts.
+
+	An executor is an object with the members:
+
+		unsigned int workers() const; // number of workers, at least one
+		template<typename F>
+		void run(F && fn) const; // calls fn(w) for each w in [0, workers()), returns when all have returned
+
+	The calls may run concurrently, to the extent the executor can, but the sorts only need
+	them to run at some point: a worker never waits for another, so running them one after
+	the other on a single thread is correct, if slow. That makes it safe to forward to a
+	thread pool that is busy, or whose workers are fewer than workers().
+
+	rs_executor_threads starts one std::thread per worker for every run. To sort on an
+	existing pool, write an executor that submits the calls to it, and waits for them.
+
+	See https://github.com/eloj/radix-sorting#parallel-msd
+*/
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "radix_sort_config.hpp"
+
+// Runs each worker on a thread of its own, or inline if there's only one.
+struct rs_executor_threads {
+	unsigned int threads = 0; // Zero means the tuned default, see rs_num_threads.
+
+	unsigned int workers(void) const {
+		return rs_num_threads(threads, SIZE_MAX);
+	}
+
+	template<typename F>
+	void run(F && fn) const {
+		unsigned int n = workers();
+		if (n == 1) {
+			fn(0U);
+			return;
+		}
+		std::vector<std::thread> pool;
+		for (unsigned int w = 0 ; w < n ; ++w) {
+			pool.emplace_back([&fn, w]() { fn(w); });
+		}
+		for (auto& t : pool) {
+			t.join();
+		}
+	}
+};
+
+// One deque of tasks per worker. A worker pops its own tasks from the back, depth first, and
+// steals others' from the front, where the oldest, and usually largest, tasks are.
+template<typename Task>
+class rs_task_queues {
+public:
+	explicit rs_task_queues(unsigned int workers) : queues(workers) { }
+
+	void push(unsigned int worker, const Task& task) {
+		++pending;
+		queue& q = queues[worker % queues.size()];
+		std::lock_guard<std::mutex> guard(q.lock);
+		q.tasks.push_back(task);
+	}
+
+	bool pop(unsigned int worker, Task *task) {
+		size_t nq = queues.size();
+		for (size_t i = 0 ; i < nq ; ++i) {
+			queue& q = queues[(worker + i) % nq];
+			std::lock_guard<std::mutex> guard(q.lock);
+			if (q.tasks.empty())
+				continue;
+			if (i == 0) {
+				*task = q.tasks.back();
+				q.tasks.pop_back();
+			} else {
+				*task = q.tasks.front();
+				q.tasks.pop_front();
+			}
+			return true;
+		}
+		return false;
+	}
+
+	// Marks a popped task as finished, after any tasks it spawned were pushed.
+	void done(void) {
+		--pending;
+	}
+
+	bool finished(void) const {
+		return pending == 0;
+	}
+
+private:
+	struct queue {
+		std::mutex lock;
+		std::deque<Task> tasks;
+	};
+	std::vector<queue> queues;
+	std::atomic<size_t> pending { 0 };
+};
+
+// Runs the tasks, and all the tasks they spawn, on the workers of ex. The initial tasks are
+// dealt out round-robin, in order, so put the large ones first. Each task is run as
+// fn(task, worker, push), where push(task) schedules a new task on the same worker.
+template<typename Task, typename Executor, typename Fn>
+void rs_run_tasks(const Executor& ex, const std::vector<Task>& tasks, Fn && fn) {
+	unsigned int workers = ex.workers();
+	rs_task_queues<Task> queues(workers);
+	for (size_t i = 0 ; i < tasks.size() ; ++i) {
+		queues.push(i % workers, tasks[i]);
+	}
+
+	ex.run([&](unsigned int w) {
+		auto push = [&queues, w](const Task& task) { queues.push(w, task); };
+		Task task;
+		while (!queues.finished()) {
+			if (!queues.pop(w, &task)) {
+				std::this_thread::yield();
+				continue;
+			}
+			fn(task, w, push);
+			queues.done();
+		}
+	});
+}
@@ -0,0 +1,117 @@
+/*
+	Sorting the contents of a file, overlapping the read with the histogram pass.
+
+	An I/O thread reads the input in blocks of rs_file_block_bytes, while the calling
+	thread builds the histograms of each block as soon as it has landed, while it's
+	still in cache. When the read finishes the histograms are complete, and the
+	sorting passes start right away, instead of first re-reading all of the input
+	from memory to build them.
+
+	See https://github.com/eloj/radix-sorting#file-sorting
+*/
+#pragma once
+
+#include <cerrno>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <fcntl.h>  // for posix_fadvise
+#include <unistd.h> // for read
+
+#include "radix_sort.hpp"
+
+template<typename T, typename KeyFunc, typename Hist, typename Alloc, typename Stats>
+T* rs_sort_fd_main(int fd, T* RESTRICT buf, T* RESTRICT aux, size_t *n, Hist& histogram, KeyFunc && kf, size_t block_bytes, const Alloc& alloc, Stats *stats) {
+	std::mutex mutex;
+	std::condition_variable cv;
+	size_t bytes_in = 0;
+	bool done = false;
+	bool failed = false;
+
+	// The kernel may double its readahead window for sequential access.
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	std::thread reader([&, capacity = *n * sizeof(T)]() {
+		char *dst = reinterpret_cast<char*>(buf);
+		size_t pos = 0;
+		while (pos < capacity) {
+			ssize_t res = read(fd, dst + pos, std::min(block_bytes, capacity - pos));
+			if (res < 0 && errno == EINTR)
+				continue;
+			if (res <= 0) {
+				failed = res < 0;
+				break;
+			}
+			pos += res;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				bytes_in = pos;
+			}
+			cv.notify_one();
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			done = true;
+		}
+		cv.notify_one();
+	});
+
+	// Histograms, block by block as they come in.
+	if (stats) stats->phase_begin(rs_phase::histogram, 0);
+	size_t n_in = 0;
+	size_t n_unordered = 0;
+	for (;;) {
+		size_t avail;
+		bool last;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			cv.wait(lock, [&]() { return done || bytes_in / sizeof(T) > n_in; });
+			avail = bytes_in / sizeof(T);
+			last = done;
+		}
+		if (avail > n_in) {
+			// The pair straddling the previous block.
+			if (n_in > 0 && !rs_key_in_order<KeyFunc>(kf(buf[n_in - 1]), kf(buf[n_in])))
+				++n_unordered;
+			n_unordered += rs_histogram(buf + n_in, avail - n_in, histogram, kf);
+			n_in = avail;
+		}
+		if (last && n_in == avail)
+			break;
+	}
+	if (stats) stats->phase_end(rs_phase::histogram, 0);
+
+	reader.join();
+	*n = n_in;
+	if (failed)
+		return nullptr;
+	if (n_in < 2)
+		return buf;
+
+	return rs_sort_from_histogram(buf, aux, n_in, histogram, n_unordered, kf, alloc, rs_prefetch_none(), stats);
+}
+
+// Reads up to *n entries of T from the current position of fd into buf, and sorts them,
+// with aux as the auxiliary buffer. Both must hold *n entries. On return *n is the number
+// of entries read, ignoring any trailing partial entry.
+//
+// Returns a pointer to the sorted entries, which are in either buf or aux, like radix_sort,
+// or null on a read error.
+template<typename T, typename KeyFunc = decltype(basic_kdfs::kdf<T>), typename Alloc = rs_alloc_malloc, typename Stats = rs_stats_none>
+T* radix_sort_fd(int fd, T* RESTRICT buf, T* RESTRICT aux, size_t *n, KeyFunc && kf = basic_kdfs::kdf, size_t block_bytes = rs_file_block_bytes, const Alloc& alloc = Alloc(), Stats *stats = nullptr) {
+	static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+	constexpr int passes = rs_popcount(rs_byte_mask_v<KeyFunc, std::result_of_t<KeyFunc&&(T)>>);
+
+	// The counter width has to be chosen up front, by the capacity.
+	if (*n < (1ULL << 16ULL)) {
+		std::array<uint16_t,256*passes> histogram{0};
+		return rs_sort_fd_main(fd, buf, aux, n, histogram, kf, block_bytes, alloc, stats);
+	} else if (*n < (1ULL << 32ULL)) {
+		std::array<uint32_t,256*passes> histogram{0};
+		return rs_sort_fd_main(fd, buf, aux, n, histogram, kf, block_bytes, alloc, stats);
+	} else {
+		std::array<uint64_t,256*passes> histogram{0};
+		return rs_sort_fd_main(fd, buf, aux, n, histogram, kf, block_bytes, alloc, stats);
+	}
+}
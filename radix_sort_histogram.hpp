@@ -0,0 +1,144 @@
+/*
+	Sorting with histograms built by the caller.
+
+	When the keys are already scanned before the sort, e.g to validate the input or to
+	gather statistics, the histograms can be built in that same scan, with radix_histogram,
+	and handed to radix_sort_with_histogram. The sort then starts straight at the column
+	selection and scatter passes, saving one full read of the input.
+
+	The builder also tracks whether the keys were added in sorted order, and the
+	minimum and maximum key.
+
+	See https://github.com/eloj/radix-sorting#precomputed-histograms
+*/
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cinttypes>
+#include <limits>
+
+#include "radix_sort.hpp"
+
+// Incremental histogram builder. The entries must be added in the order they'll have in
+// the array that is sorted, for the sortedness to be right.
+template<typename T, typename KeyFunc = basic_kdfs::kdf_object>
+class radix_histogram {
+public:
+	typedef std::decay_t<KeyFunc> KF;
+	typedef typename std::result_of_t<KF&(T)> KeyType;
+	static constexpr uint8_t byte_mask = rs_byte_mask_v<KF, KeyType>;
+	static constexpr size_t passes = rs_popcount(byte_mask);
+	static constexpr unsigned int hist_len = 256;
+	typedef uint64_t counter_type;
+
+	explicit radix_histogram(KeyFunc kf = KeyFunc()) : keyfunc(kf) {
+		clear();
+	}
+
+	void clear(void) {
+		counts.fill(0);
+		count = 0;
+		n_unordered = 0;
+		min = std::numeric_limits<KeyType>::max();
+		max = 0;
+		// The first key is always in order after this.
+		last = rs_descending_v<KF> ? std::numeric_limits<KeyType>::max() : 0;
+	}
+
+	// Add one entry. The compiler has to assume that the counter increments may alias the
+	// other members, so they go through memory on every call; prefer adding blocks.
+	inline void add(const T& value) {
+		constexpr std::array<uint8_t, 8> shift_table = rs_mask_shifts(byte_mask);
+		KeyType key = keyfunc(value);
+		n_unordered += !rs_key_in_order<KF>(last, key);
+		last = key;
+		min = std::min(min, key);
+		max = std::max(max, key);
+		rs_unroll<passes>([&](auto j) {
+			++counts[(hist_len*j) + ((key >> shift_table[j]) & 0xFF)];
+		});
+		++count;
+	}
+
+	// Add n consecutive entries, e.g each block of the input right after the caller's own
+	// scan of it, while it's still in cache. The running state is kept in locals.
+	void add(const T* src, size_t n) {
+		constexpr std::array<uint8_t, 8> shift_table = rs_mask_shifts(byte_mask);
+		KeyType prev = last;
+		KeyType lo = min;
+		KeyType hi = max;
+		size_t unordered = n_unordered;
+		for (size_t i = 0 ; i < n ; ++i) {
+			KeyType key = keyfunc(src[i]);
+			unordered += !rs_key_in_order<KF>(prev, key);
+			prev = key;
+			lo = std::min(lo, key);
+			hi = std::max(hi, key);
+			rs_unroll<passes>([&](auto j) {
+				++counts[(hist_len*j) + ((key >> shift_table[j]) & 0xFF)];
+			});
+		}
+		last = prev;
+		min = lo;
+		max = hi;
+		n_unordered = unordered;
+		count += n;
+	}
+
+	// Number of entries added.
+	size_t size(void) const { return count; }
+	// Number of adjacent entries that are out of order, in the order of the KDF.
+	size_t unordered(void) const { return n_unordered; }
+	bool sorted(void) const { return n_unordered == 0; }
+	// Smallest and largest key, as returned by the KDF. Only valid if size() > 0.
+	KeyType min_key(void) const { return min; }
+	KeyType max_key(void) const { return max; }
+
+	const KF& key_func(void) const { return keyfunc; }
+	// The histograms, hist_len counters for each byte of the key in byte_mask, from the LSB.
+	const std::array<counter_type, hist_len*passes>& histogram(void) const { return counts; }
+
+private:
+	KF keyfunc;
+	std::array<counter_type, hist_len*passes> counts;
+	size_t count;
+	size_t n_unordered;
+	KeyType min;
+	KeyType max;
+	KeyType last;
+};
+
+// The histograms are copied to counters of width HVT, since the sort consumes them.
+template<typename HVT, typename T, typename KeyFunc, typename Alloc, typename Prefetch, typename Stats>
+T* rs_sort_with_histogram(T* RESTRICT src, T* RESTRICT aux, size_t n, const radix_histogram<T, KeyFunc>& hist, const Alloc& alloc, const Prefetch& pf, Stats *stats) {
+	constexpr size_t len = radix_histogram<T, KeyFunc>::hist_len * radix_histogram<T, KeyFunc>::passes;
+	std::array<HVT, len> histogram;
+	std::copy(hist.histogram().begin(), hist.histogram().end(), histogram.begin());
+	return rs_sort_from_histogram(src, aux, n, histogram, hist.unordered(), hist.key_func(), alloc, pf, stats);
+}
+
+// Sorts src like radix_sort, but with the histograms from hist, which must have been built
+// from exactly the n entries of src, in order. The histogram pass is skipped.
+//
+// Returns a pointer to the sorted entries, which are in either src or aux, or null if
+// hist does not hold n entries. hist is left as is, and can be reused.
+template<typename T, typename KeyFunc, typename Alloc = rs_alloc_malloc, typename Prefetch = rs_prefetch_none, typename Stats = rs_stats_none>
+T* radix_sort_with_histogram(T* RESTRICT src, T* RESTRICT aux, size_t n, const radix_histogram<T, KeyFunc>& hist, const Alloc& alloc = Alloc(), const Prefetch& pf = Prefetch(), Stats *stats = nullptr) {
+	if (hist.size() != n)
+		return nullptr;
+
+	if (n < 2) {
+		return src;
+	} else if (n < rs_small_n) {
+		return rs_sort_small(src, n, hist.key_func(), stats);
+	} else if (n < 256) {
+		return rs_sort_with_histogram<uint8_t>(src, aux, n, hist, alloc, pf, stats);
+	} else if (n < (1ULL << 16ULL)) {
+		return rs_sort_with_histogram<uint16_t>(src, aux, n, hist, alloc, pf, stats);
+	} else if (n < (1ULL << 32ULL)) {
+		return rs_sort_with_histogram<uint32_t>(src, aux, n, hist, alloc, pf, stats);
+	} else {
+		return rs_sort_with_histogram<uint64_t>(src, aux, n, hist, alloc, pf, stats);
+	}
+}
@@ -0,0 +1,356 @@
+/*
+	Parallel in-place MSD radix sort, with block permutation, after IPS²Ra.
+
+	Axtmann, Witt, Ferizovic and Sanders, "Engineering In-place (Shared-memory) Sorting
+	Algorithms", 2020. https://arxiv.org/abs/2009.13569
+
+	Each level partitions its range on one key byte, from the most significant down:
+
+	1. Classification. Each thread scans a stripe of the range, appending each entry to
+	   one of 256 block-sized buffers by its bucket. A full buffer is written back, as a
+	   block, to the start of the stripe, which has already been read. Afterwards each
+	   stripe holds full blocks, each of one bucket, followed by free space.
+	2. The bucket boundaries are the prefix sum of the counts. The blocks of each bucket
+	   are to go in its range rounded up to whole blocks.
+	3. All full blocks are moved to the front of the range, so that every bucket's range
+	   holds unprocessed blocks followed by free slots.
+	4. Block permutation. The threads take unprocessed blocks and swap them into the next
+	   slot of their bucket, until each bucket holds only its own blocks.
+	5. Cleanup. The partial blocks left in the buffers, and the blocks that stick out past
+	   the end of their bucket, are written to the start and end of the buckets.
+
+	Only whole blocks are moved by the threads in parallel, so the extra memory is a few
+	blocks per bucket and thread, O(threads * buckets * block), not the O(n) of radix_sort.
+	Buckets of at most 256 blocks are sorted with radix_sort, using a buffer of that size.
+
+	The top level is partitioned by all threads. The buckets are then sorted as tasks,
+	each thread working off its own deque of tasks, and stealing from the others when
+	it runs out, see rs_run_tasks. The sort is not stable.
+
+	See https://github.com/eloj/radix-sorting#in-place
+*/
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cinttypes>
+#include <mutex>
+#include <vector>
+
+#include "radix_sort.hpp"
+#include "radix_sort_executor.hpp"
+
+constexpr unsigned int rs_inplace_k = 256;
+
+// Entries per block.
+template<typename T>
+constexpr size_t rs_inplace_block_n = std::max<size_t>(1, rs_inplace_block_bytes / sizeof(T));
+
+// Per-thread memory: a buffer per bucket, two blocks for swapping, one for the block that
+// would stick out past the end of the range, and the base case buffer.
+template<typename T>
+struct rs_inplace_scratch {
+	static constexpr size_t B = rs_inplace_block_n<T>;
+	static constexpr size_t bytes = sizeof(T) * B * (2 * rs_inplace_k + 3);
+
+	T *buffers;
+	T *swap;
+	T *overflow;
+	T *aux;
+	std::array<size_t, rs_inplace_k> fill;
+	std::array<size_t, rs_inplace_k> counts;
+	size_t stripe_begin;
+	size_t stripe_end;
+	size_t flushed_end;
+
+	explicit rs_inplace_scratch(void *mem) : buffers(static_cast<T*>(mem)), swap(buffers + B * rs_inplace_k), overflow(swap + 2 * B), aux(overflow + B) { }
+};
+
+// A range of the array, to be sorted on the key byte shift_table[col] and below.
+struct rs_inplace_task {
+	size_t begin;
+	size_t n;
+	unsigned int col;
+};
+
+template<typename KeyFunc, typename KeyType>
+inline unsigned int rs_inplace_bucket(KeyType key, unsigned int shift) {
+	unsigned int digit = (key >> shift) & 0xFF;
+	return rs_descending_v<KeyFunc> ? rs_inplace_k - 1 - digit : digit;
+}
+
+// Phase 1, for one stripe.
+template<typename T, typename KeyFunc>
+void rs_inplace_classify(T* arr, rs_inplace_scratch<T>& s, unsigned int shift, KeyFunc && kf) {
+	constexpr size_t B = rs_inplace_scratch<T>::B;
+	s.fill.fill(0);
+	s.counts.fill(0);
+	size_t w = s.stripe_begin;
+	for (size_t i = s.stripe_begin ; i < s.stripe_end ; ++i) {
+		unsigned int k = rs_inplace_bucket<KeyFunc>(kf(arr[i]), shift);
+		++s.counts[k];
+		T *buf = s.buffers + k * B;
+		buf[s.fill[k]++] = arr[i];
+		if (s.fill[k] == B) {
+			std::copy(buf, buf + B, arr + w);
+			w += B;
+			s.fill[k] = 0;
+		}
+	}
+	s.flushed_end = w;
+}
+
+// Shared state of the block permutation. Each bucket has a write pointer, the next slot
+// for one of its blocks, and a read pointer, the end of its unprocessed blocks. Both are
+// only touched under the bucket's lock, as is the block being read or written.
+struct rs_inplace_pointers {
+	struct alignas(rs_cacheline) bucket {
+		std::mutex lock;
+		size_t w;
+		size_t r;
+	};
+	std::array<bucket, rs_inplace_k> buckets;
+	// The bucket of the block that would stick out past the end, and where it went instead.
+	size_t overflow_bucket = rs_inplace_k;
+	const void *overflow = nullptr;
+};
+
+// Phase 4, for one thread. The block that would stick out past the end of the range is
+// written to overflow instead; there is at most one such block.
+template<typename T, typename KeyFunc>
+void rs_inplace_permute(T* arr, size_t n, rs_inplace_pointers& ptrs, T* overflow, T* swap, unsigned int first_bucket, unsigned int shift, KeyFunc && kf) {
+	constexpr size_t B = rs_inplace_block_n<T>;
+	T *carry = swap;
+	T *next = swap + B;
+	for (unsigned int b = 0 ; b < rs_inplace_k ; ++b) {
+		auto& src = ptrs.buckets[(first_bucket + b) % rs_inplace_k];
+		for (;;) {
+			{
+				std::lock_guard<std::mutex> guard(src.lock);
+				if (src.r <= src.w)
+					break;
+				src.r -= B;
+				std::copy(arr + src.r, arr + src.r + B, carry);
+			}
+			// Carry the block to its bucket, swapping out unprocessed blocks, until a free slot is found.
+			for (bool placed = false ; !placed ; ) {
+				unsigned int j = rs_inplace_bucket<KeyFunc>(kf(carry[0]), shift);
+				auto& dst = ptrs.buckets[j];
+				std::lock_guard<std::mutex> guard(dst.lock);
+				size_t p = dst.w;
+				dst.w += B;
+				if (p < dst.r) {
+					std::copy(arr + p, arr + p + B, next);
+					std::copy(carry, carry + B, arr + p);
+					std::swap(carry, next);
+				} else if (p + B > n) {
+					std::copy(carry, carry + B, overflow);
+					ptrs.overflow_bucket = j;
+					ptrs.overflow = overflow;
+					placed = true;
+				} else {
+					std::copy(carry, carry + B, arr + p);
+					placed = true;
+				}
+			}
+		}
+	}
+}
+
+// Partitions arr[0..n) on the key byte at shift, using the given per-thread scratch, one
+// thread per scratch. Writes the bucket boundaries to d, which must hold rs_inplace_k + 1 entries.
+template<typename T, typename KeyFunc>
+void rs_inplace_partition(T* arr, size_t n, unsigned int shift, KeyFunc && kf, const std::vector<rs_inplace_scratch<T>*>& scratch, size_t *d) {
+	constexpr size_t B = rs_inplace_block_n<T>;
+	constexpr unsigned int K = rs_inplace_k;
+	size_t threads = scratch.size();
+	auto align_up = [](size_t x) { return (x + B - 1) / B * B; };
+
+	rs_executor_threads ex { unsigned(threads) };
+
+	// 1. Classification, in stripes of whole blocks.
+	size_t blocks = n / B;
+	for (size_t t = 0 ; t < threads ; ++t) {
+		scratch[t]->stripe_begin = blocks * t / threads * B;
+		scratch[t]->stripe_end = t + 1 < threads ? blocks * (t + 1) / threads * B : n;
+	}
+	ex.run([&](unsigned int t) {
+		rs_inplace_classify(arr, *scratch[t], shift, kf);
+	});
+
+	// 2. Bucket boundaries.
+	size_t full = 0;
+	d[0] = 0;
+	for (unsigned int k = 0 ; k < K ; ++k) {
+		size_t c = 0;
+		for (size_t t = 0 ; t < threads ; ++t) {
+			c += scratch[t]->counts[k];
+		}
+		d[k + 1] = d[k] + c;
+	}
+	for (size_t t = 0 ; t < threads ; ++t) {
+		full += scratch[t]->flushed_end - scratch[t]->stripe_begin;
+	}
+
+	// 3. Move the full blocks above `full` into the free slots below it. There are as
+	// many of one as of the other.
+	{
+		size_t dst_t = 0;
+		size_t dst = scratch[0]->flushed_end;
+		for (size_t t = threads ; t-- > 0 ; ) {
+			size_t lo = std::max(scratch[t]->stripe_begin, full);
+			for (size_t src = scratch[t]->flushed_end ; src > lo ; ) {
+				src -= B;
+				while (dst + B > scratch[dst_t]->stripe_end) {
+					dst = scratch[++dst_t]->flushed_end;
+				}
+				std::copy(arr + src, arr + src + B, arr + dst);
+				dst += B;
+			}
+		}
+	}
+
+	// 4. Block permutation.
+	rs_inplace_pointers ptrs;
+	for (unsigned int k = 0 ; k < K ; ++k) {
+		size_t a = align_up(d[k]);
+		size_t a_next = align_up(d[k + 1]);
+		ptrs.buckets[k].w = a;
+		ptrs.buckets[k].r = std::clamp(full, a, a_next);
+	}
+	ex.run([&](unsigned int t) {
+		rs_inplace_permute(arr, n, ptrs, scratch[t]->overflow, scratch[t]->swap, t * K / threads, shift, kf);
+	});
+
+	// 5. Cleanup, in bucket order, as the block sticking out of bucket k is in the head
+	// of bucket k+1, which is overwritten when that is cleaned up.
+	for (unsigned int k = 0 ; k < K ; ++k) {
+		size_t a_k = align_up(d[k]);
+		size_t a = std::min(a_k, d[k + 1]);
+		size_t w = ptrs.buckets[k].w;
+		bool has_overflow = ptrs.overflow_bucket == k;
+		if (has_overflow)
+			w -= B;
+
+		// The destinations are the head, [d[k], a), then the tail, [w, d[k+1]).
+		size_t pos = d[k];
+		auto emit = [&](const T* first, const T* last) {
+			for ( ; first != last ; ++first) {
+				if (pos == a)
+					pos = std::max(a, w);
+				arr[pos++] = *first;
+			}
+		};
+		// Blocks were written to [a_k, w), of which the part past d[k+1] sticks out.
+		if (w > std::max(a_k, d[k + 1])) {
+			emit(arr + d[k + 1], arr + w);
+		}
+		if (has_overflow) {
+			const T *block = static_cast<const T*>(ptrs.overflow);
+			emit(block, block + B);
+		}
+		for (size_t t = 0 ; t < threads ; ++t) {
+			emit(scratch[t]->buffers + k * B, scratch[t]->buffers + k * B + scratch[t]->fill[k]);
+		}
+	}
+}
+
+// Sorts a task on one thread: small ranges with radix_sort, larger ones by partitioning,
+// pushing the buckets as new tasks.
+template<typename T, typename KeyFunc, typename Push>
+void rs_inplace_task_run(T* arr, const rs_inplace_task& task, KeyFunc && kf, rs_inplace_scratch<T>* scratch, Push && push) {
+	typedef typename std::result_of_t<KeyFunc&&(T)> KeyType;
+	constexpr std::array<uint8_t, 8> shift_table = rs_mask_shifts(rs_byte_mask_v<KeyFunc, KeyType>);
+	constexpr size_t base_n = rs_inplace_block_n<T> * rs_inplace_k;
+
+	T *src = arr + task.begin;
+	if (task.n <= base_n) {
+		T *res = radix_sort(src, scratch->aux, task.n, kf);
+		if (res != src)
+			std::copy(res, res + task.n, src);
+		return;
+	}
+
+	std::array<size_t, rs_inplace_k + 1> d;
+	rs_inplace_partition(src, task.n, shift_table[task.col], kf, { scratch }, d.data());
+	if (task.col == 0)
+		return;
+	for (unsigned int k = 0 ; k < rs_inplace_k ; ++k) {
+		if (d[k + 1] - d[k] > 1)
+			push(rs_inplace_task { task.begin + d[k], d[k + 1] - d[k], task.col - 1 });
+	}
+}
+
+// Sorts arr in place, using O(threads * 256 * block) extra memory, see above and
+// RS_TUNE_INPLACE_BLOCK_BYTES. A thread count of zero means the tuned default.
+// The sort is NOT stable.
+//
+// Returns false, with arr untouched, if the per-thread buffers could not be allocated.
+template<typename T, typename KeyFunc = basic_kdfs::kdf_object, typename Alloc = rs_alloc_malloc>
+bool radix_sort_inplace(T* arr, size_t n, KeyFunc && kf = KeyFunc(), unsigned int threads = 0, const Alloc& alloc = Alloc()) {
+	static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+	typedef typename std::result_of_t<KeyFunc&&(T)> KeyType;
+	typedef rs_inplace_scratch<T> Scratch;
+	constexpr unsigned int wc = rs_popcount(rs_byte_mask_v<KeyFunc, KeyType>);
+	constexpr std::array<uint8_t, 8> shift_table = rs_mask_shifts(rs_byte_mask_v<KeyFunc, KeyType>);
+
+	if (n < 2)
+		return true;
+	threads = rs_num_threads(threads, n);
+
+	std::vector<void*> mem(threads);
+	std::vector<Scratch> scratch;
+	std::vector<Scratch*> all;
+	bool ok = true;
+	for (unsigned int t = 0 ; t < threads ; ++t) {
+		mem[t] = alloc.allocate(Scratch::bytes);
+		ok = ok && mem[t];
+		scratch.emplace_back(mem[t]);
+	}
+	for (auto& s : scratch) {
+		all.push_back(&s);
+	}
+	auto release = [&]() {
+		for (unsigned int t = 0 ; t < threads ; ++t) {
+			alloc.deallocate(mem[t], Scratch::bytes);
+		}
+	};
+	if (!ok) {
+		release();
+		return false;
+	}
+
+	rs_inplace_task root { 0, n, wc - 1 };
+	if (threads == 1 || n <= rs_inplace_block_n<T> * rs_inplace_k) {
+		std::vector<rs_inplace_task> stack { root };
+		while (!stack.empty()) {
+			rs_inplace_task task = stack.back();
+			stack.pop_back();
+			rs_inplace_task_run(arr, task, kf, all[0], [&stack](const rs_inplace_task& sub) { stack.push_back(sub); });
+		}
+		release();
+		return true;
+	}
+
+	// The top level is partitioned by all threads, one stripe each.
+	std::array<size_t, rs_inplace_k + 1> d;
+	rs_inplace_partition(arr, n, shift_table[wc - 1], kf, all, d.data());
+	if (wc == 1) {
+		release();
+		return true;
+	}
+
+	// The buckets are dealt out largest first, see rs_run_tasks.
+	std::vector<rs_inplace_task> top;
+	for (unsigned int k = 0 ; k < rs_inplace_k ; ++k) {
+		if (d[k + 1] - d[k] > 1)
+			top.push_back({ d[k], d[k + 1] - d[k], wc - 2 });
+	}
+	std::sort(top.begin(), top.end(), [](const rs_inplace_task& a, const rs_inplace_task& b) { return a.n > b.n; });
+	rs_run_tasks(rs_executor_threads { threads }, top, [&](const rs_inplace_task& task, unsigned int w, auto && push) {
+		rs_inplace_task_run(arr, task, kf, all[w], push);
+	});
+
+	release();
+	return true;
+}
@@ -0,0 +1,116 @@
+/*
+	Lazy sorted iteration: for consumers that may only read the start of the sorted output.
+
+	The constructor does one MSD pass, rs_msd_partition, partitioning the input by the
+	most significant key byte that varies. Each of the 256 buckets is then sorted, with radix_sort, the
+	first time the iteration reaches it. The time to the first element is one histogram
+	pass, one scatter pass, and the sorting of the first non-empty bucket.
+
+	See https://github.com/eloj/radix-sorting#lazy
+*/
+#pragma once
+
+#include <array>
+#include <cinttypes>
+#include <iterator>
+#include <type_traits>
+
+#include "radix_sort.hpp"
+
+// The sorted entries are kept in buf or aux, both of which must hold n entries, and
+// must outlive the range. The input is not modified.
+template<typename T, typename KeyFunc = basic_kdfs::kdf_object>
+class radix_sorted_range {
+	typedef std::decay_t<KeyFunc> KF;
+	static constexpr unsigned int hist_len = 256;
+
+public:
+	class iterator {
+	public:
+		typedef std::input_iterator_tag iterator_category;
+		typedef T value_type;
+		typedef ptrdiff_t difference_type;
+		typedef const T* pointer;
+		typedef const T& reference;
+
+		iterator(radix_sorted_range *r, unsigned int b) : range(r), bucket(b) {
+			enter();
+		}
+
+		reference operator*() const { return *cur; }
+		pointer operator->() const { return cur; }
+
+		iterator& operator++() {
+			if (++cur == end) {
+				++bucket;
+				enter();
+			}
+			return *this;
+		}
+
+		bool operator==(const iterator& other) const {
+			return bucket == other.bucket && (bucket == hist_len || cur == other.cur);
+		}
+		bool operator!=(const iterator& other) const {
+			return !(*this == other);
+		}
+
+	private:
+		// Move to the first entry of the first non-empty bucket from here on, sorting it.
+		void enter(void) {
+			size_t len = 0;
+			for ( ; bucket < hist_len ; ++bucket) {
+				cur = range->bucket(bucket, &len);
+				if (len > 0)
+					break;
+			}
+			end = cur + len;
+		}
+
+		radix_sorted_range *range;
+		unsigned int bucket;
+		const T *cur = nullptr;
+		const T *end = nullptr;
+	};
+
+	radix_sorted_range(const T* RESTRICT src, T* RESTRICT buf, T* RESTRICT aux, size_t n, KeyFunc kf = KeyFunc()) : out(buf), scratch(aux), count(n), keyfunc(kf) {
+		// If the input was in order, so are the buckets.
+		bool in_order = rs_msd_partition(src, out, n, keyfunc, offsets.data()) == 0;
+		sorted.fill(in_order);
+	}
+
+	// The sorted entries of the i:th bucket in iteration order, sorting it on first access.
+	const T* bucket(unsigned int i, size_t *len) {
+		T *start = out + offsets[i];
+		*len = offsets[i + 1] - offsets[i];
+		if (!sorted[i]) {
+			T *res = radix_sort(start, scratch + offsets[i], *len, keyfunc);
+			sorted[i] = true;
+			in_scratch[i] = res != start;
+		}
+		return in_scratch[i] ? scratch + offsets[i] : start;
+	}
+
+	iterator begin(void) { return iterator(this, 0); }
+	iterator end(void) { return iterator(this, hist_len); }
+
+	size_t size(void) const { return count; }
+
+	// Number of buckets that have been sorted so far.
+	unsigned int buckets_sorted(void) const {
+		unsigned int res = 0;
+		for (unsigned int i = 0 ; i < hist_len ; ++i) {
+			res += sorted[i] && offsets[i + 1] > offsets[i];
+		}
+		return res;
+	}
+
+private:
+	T *out;
+	T *scratch;
+	size_t count;
+	KF keyfunc;
+	std::array<size_t, hist_len + 1> offsets;
+	std::array<bool, hist_len> sorted;
+	std::array<bool, hist_len> in_scratch {};
+};
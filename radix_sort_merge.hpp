@@ -0,0 +1,200 @@
+/*
+	Merging sorted spans, e.g chunks sorted by different workers with radix_sort.
+
+	The order is defined by the same KDFs as the sort, compared as unsigned keys, so
+	that signed and floating point values, and descending KDFs, merge consistently
+	with how they were sorted. Merges are stable; on like-keys, elements from
+	earlier spans come first.
+
+	The parallel merges split the output into one contiguous range per thread, and
+	use a binary search along the cross diagonal of the merge matrix, the "merge path",
+	to find where in each input a range starts. See Odeh et al, "Merge Path - Parallel
+	Merging Made Simple", 2012.
+
+	See https://github.com/eloj/radix-sorting#merging
+*/
+#pragma once
+
+#include <algorithm>
+#include <cinttypes>
+#include <thread>
+#include <vector>
+
+#include "radix_sort_alloc.hpp"
+#include "radix_sort_basic_kdf.hpp"
+#include "radix_sort_config.hpp"
+
+#ifndef RESTRICT
+#define RESTRICT __restrict__
+#endif
+
+// True if x must be output before y.
+template<typename KeyFunc, typename T>
+inline bool rs_merge_before(KeyFunc && kf, const T& x, const T& y) {
+	if constexpr (rs_descending_v<KeyFunc>) {
+		return kf(y) < kf(x);
+	} else {
+		return kf(x) < kf(y);
+	}
+}
+
+// Number of elements taken from a among the first diag elements of the merge of a and b.
+template<typename T, typename KeyFunc>
+size_t rs_merge_path(const T* a, size_t na, const T* b, size_t nb, size_t diag, KeyFunc && kf) {
+	size_t lo = diag > nb ? diag - nb : 0;
+	size_t hi = std::min(diag, na);
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		// On like-keys a goes first, so a[mid] is in the prefix unless b[diag-mid-1] must go before it.
+		if (rs_merge_before(kf, b[diag - mid - 1], a[mid])) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+	return lo;
+}
+
+// Sequential merge of the first n elements of the merge of a and b into dst.
+template<typename T, typename KeyFunc>
+void rs_merge_n(const T* RESTRICT a, size_t na, const T* RESTRICT b, size_t nb, T* RESTRICT dst, size_t n, KeyFunc && kf) {
+	size_t i = 0;
+	size_t j = 0;
+	size_t k = 0;
+	// Each step takes one element, so neither input can run out within the shortest
+	// remaining length, which keeps the bounds checks out of the inner loop. It's
+	// branch-free, since which input goes next is unpredictable.
+	for (size_t steps = std::min({ n, na, nb }) ; steps > 0 ; steps = std::min({ n - k, na - i, nb - j })) {
+		for (size_t end = k + steps ; k < end ; ++k) {
+			bool take_b = rs_merge_before(kf, b[j], a[i]);
+			dst[k] = take_b ? b[j] : a[i];
+			j += take_b;
+			i += !take_b;
+		}
+	}
+	while (k < n && i < na) {
+		dst[k++] = a[i++];
+	}
+	while (k < n && j < nb) {
+		dst[k++] = b[j++];
+	}
+}
+
+// Writes the range [start, end) of the merge of a and b to dst + start.
+template<typename T, typename KeyFunc>
+void rs_merge_range(const T* RESTRICT a, size_t na, const T* RESTRICT b, size_t nb, T* RESTRICT dst, size_t start, size_t end, KeyFunc && kf) {
+	size_t i = rs_merge_path(a, na, b, nb, start, kf);
+	size_t j = start - i;
+	rs_merge_n(a + i, na - i, b + j, nb - j, dst + start, end - start, kf);
+}
+
+// Runs fn(start, end) over n elements split into one range per thread.
+template<typename Fn>
+void rs_merge_parallel_for(size_t n, unsigned int threads, Fn && fn) {
+	if (threads < 2) {
+		fn(0, n);
+		return;
+	}
+	std::vector<std::thread> workers;
+	size_t chunk = (n + threads - 1) / threads;
+	for (size_t start = 0 ; start < n ; start += chunk) {
+		size_t end = std::min(n, start + chunk);
+		workers.emplace_back([&fn, start, end]() { fn(start, end); });
+	}
+	for (auto& w : workers) {
+		w.join();
+	}
+}
+
+// 2-way merge of a and b into dst, which must hold na + nb elements.
+// A thread count of zero means use the tuned default, see radix_sort_config.hpp.
+template<typename T, typename KeyFunc = decltype(basic_kdfs::kdf<T>)>
+T* radix_merge(const T* RESTRICT a, size_t na, const T* RESTRICT b, size_t nb, T* RESTRICT dst, KeyFunc && kf = basic_kdfs::kdf, unsigned int threads = 0) {
+	size_t n = na + nb;
+	rs_merge_parallel_for(n, rs_num_threads(threads, n), [&](size_t start, size_t end) {
+		rs_merge_range(a, na, b, nb, dst, start, end, kf);
+	});
+	return dst;
+}
+
+// One round of a k-way merge: the spans, of lengths offsets[i+1] - offsets[i], are merged
+// pairwise into dst, at the same offsets. An odd span out is copied. Returns the number
+// of spans left, whose offsets are written to next_offsets.
+template<typename T, typename KeyFunc>
+size_t rs_merge_round(const T* const* spans, T* RESTRICT dst, const size_t* offsets, size_t k, size_t* next_offsets, KeyFunc && kf, unsigned int threads) {
+	rs_merge_parallel_for(offsets[k], threads, [&](size_t start, size_t end) {
+		// The pairs overlapping this thread's part of the output.
+		for (size_t p = 0 ; p < k ; p += 2) {
+			size_t lo = offsets[p];
+			size_t hi = offsets[std::min(p + 2, k)];
+			if (hi <= start || lo >= end)
+				continue;
+			size_t na = offsets[p + 1] - offsets[p];
+			size_t nb = p + 1 < k ? offsets[p + 2] - offsets[p + 1] : 0;
+			rs_merge_range(spans[p], na, p + 1 < k ? spans[p + 1] : spans[p], nb, dst + lo, std::max(start, lo) - lo, std::min(end, hi) - lo, kf);
+		}
+	});
+
+	size_t m = 0;
+	for (size_t p = 0 ; p < k ; p += 2) {
+		next_offsets[m++] = offsets[p];
+	}
+	next_offsets[m] = offsets[k];
+	return m;
+}
+
+// k-way merge of the spans spans[i] of lens[i] elements each, into dst.
+//
+// The spans are merged pairwise in ceil(log2(k)) rounds, alternating between dst
+// and aux, the first round reading the spans in place. Both must hold the sum of lens.
+// The rounds are arranged so that the last one writes to dst. If aux is null, a buffer
+// is allocated with alloc. Returns dst, or null if that allocation failed.
+template<typename T, typename KeyFunc = decltype(basic_kdfs::kdf<T>), typename Alloc = rs_alloc_malloc>
+T* radix_merge_k(const T* const* spans, const size_t* lens, size_t k, T* RESTRICT dst, T* RESTRICT aux, KeyFunc && kf = basic_kdfs::kdf, unsigned int threads = 0, const Alloc& alloc = Alloc()) {
+	std::vector<size_t> offsets(k + 1);
+	std::vector<size_t> next_offsets(k / 2 + 2);
+	std::vector<const T*> ptrs(spans, spans + k);
+	offsets[0] = 0;
+	for (size_t i = 0 ; i < k ; ++i) {
+		offsets[i + 1] = offsets[i] + lens[i];
+	}
+	size_t n = offsets[k];
+	threads = rs_num_threads(threads, n);
+
+	if (n == 0) {
+		return dst;
+	} else if (k == 1) {
+		std::copy(spans[0], spans[0] + n, dst);
+		return dst;
+	} else if (k == 2) {
+		return radix_merge(spans[0], lens[0], spans[1], lens[1], dst, kf, threads);
+	}
+
+	bool own_aux = aux == nullptr;
+	if (own_aux) {
+		aux = static_cast<T*>(alloc.allocate(sizeof(T) * n));
+		if (!aux)
+			return nullptr;
+	}
+
+	size_t rounds = 0;
+	for (size_t m = k ; m > 1 ; m = (m + 1) / 2) {
+		++rounds;
+	}
+	T *out = rounds & 1 ? dst : aux;
+	T *other = rounds & 1 ? aux : dst;
+
+	while (k > 1) {
+		k = rs_merge_round(ptrs.data(), out, offsets.data(), k, next_offsets.data(), kf, threads);
+		std::copy(next_offsets.begin(), next_offsets.begin() + k + 1, offsets.begin());
+		for (size_t i = 0 ; i < k ; ++i) {
+			ptrs[i] = out + offsets[i];
+		}
+		std::swap(out, other);
+	}
+
+	if (own_aux)
+		alloc.deallocate(aux, sizeof(T) * n);
+
+	return dst;
+}
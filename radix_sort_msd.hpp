@@ -0,0 +1,183 @@
+/*
+	Parallel MSD radix sort, with work-stealing, for skewed key distributions.
+
+	Splitting the input into one chunk per thread and merging, or running LSD passes over
+	the chunks, balances the work evenly. But partitioning on the most significant byte
+	first, so that the buckets can be sorted independently, does not, if the keys are
+	skewed: with Zipf-like keys, one bucket often holds half the data.
+
+	So the top level is partitioned by all workers, each taking one chunk of the input,
+	and any bucket that is still larger than a worker's share is partitioned again, the
+	same way. The remaining buckets become tasks on a work-stealing scheduler, see
+	rs_run_tasks. A task larger than rs_msd_task_n is split by one sequential MSD pass into
+	new tasks, which other workers can steal, and a smaller one is sorted with radix_sort.
+
+	Each MSD pass goes on the most significant byte that varies within the bucket, so that
+	long common prefixes cost one histogram pass each. The sort is stable.
+
+	See https://github.com/eloj/radix-sorting#parallel-msd
+*/
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cinttypes>
+#include <vector>
+
+#include "radix_sort.hpp"
+#include "radix_sort_executor.hpp"
+
+// A bucket still to be sorted, entries [begin, begin + n) of either src or aux.
+struct rs_msd_task {
+	size_t begin;
+	size_t n;
+	bool in_aux;
+};
+
+// rs_msd_partition, with each worker of ex histogramming and scattering one chunk of src.
+// Unlike rs_msd_partition, nothing is written to dst if src is already sorted, which is
+// the case when zero is returned.
+template<typename T, typename KeyFunc, typename Executor, typename KeyType=typename std::result_of_t<KeyFunc&&(T)>>
+size_t rs_msd_partition_parallel(const T* RESTRICT src, T* RESTRICT dst, size_t n, KeyFunc && kf, const Executor& ex, size_t *offsets) {
+	constexpr uint8_t byte_mask = rs_byte_mask_v<KeyFunc, KeyType>;
+	constexpr size_t wc = rs_popcount(byte_mask);
+	constexpr std::array<uint8_t, 8> shift_table = rs_mask_shifts(byte_mask);
+	constexpr unsigned int hist_len = 256;
+	constexpr bool descending = rs_descending_v<KeyFunc>;
+	const unsigned int workers = ex.workers();
+	auto chunk_begin = [n, workers](size_t w) { return n * w / workers; };
+
+	std::fill(offsets, offsets + hist_len + 1, n);
+	offsets[0] = 0;
+	if (n == 0)
+		return 0;
+
+	// Histograms of all key bytes, to find the one to partition on, and pre-sorted detection
+	// within the chunks and across their boundaries.
+	std::vector<size_t> histograms(size_t(workers) * hist_len * wc);
+	std::vector<size_t> unordered(workers);
+	ex.run([&](unsigned int w) {
+		size_t start = chunk_begin(w);
+		size_t end = chunk_begin(w + 1);
+		size_t *histogram = histograms.data() + size_t(w) * hist_len * wc;
+		unordered[w] = rs_histogram(src + start, end - start, histogram, kf);
+		if (start < end && end < n && !rs_key_in_order<KeyFunc>(kf(src[end - 1]), kf(src[end])))
+			++unordered[w];
+	});
+	size_t n_unordered = 0;
+	for (unsigned int w = 0 ; w < workers ; ++w) {
+		n_unordered += unordered[w];
+	}
+	if (n_unordered == 0)
+		return 0;
+
+	// Pick the most significant byte that varies.
+	auto count_of = [&](unsigned int col, unsigned int bucket) {
+		size_t c = 0;
+		for (unsigned int w = 0 ; w < workers ; ++w) {
+			c += histograms[(size_t(w) * wc + col) * hist_len + bucket];
+		}
+		return c;
+	};
+	KeyType key0 = kf(*src);
+	unsigned int col = wc;
+	while (col > 0 && count_of(col - 1, (key0 >> shift_table[col - 1]) & 0xFF) == n) {
+		--col;
+	}
+	if (col == 0) {
+		std::copy(src, src + n, dst);
+		return n_unordered;
+	}
+	--col;
+	unsigned int shift = shift_table[col];
+
+	// Exclusive scan, from the top bucket down for descending order, and by worker within
+	// each bucket, so the scatter is stable. The histograms become the output positions.
+	size_t a = 0;
+	for (unsigned int j = 0 ; j < hist_len ; ++j) {
+		unsigned int bucket = descending ? hist_len - 1 - j : j;
+		offsets[j] = a;
+		for (unsigned int w = 0 ; w < workers ; ++w) {
+			size_t& pos = histograms[(size_t(w) * wc + col) * hist_len + bucket];
+			size_t b = pos;
+			pos = a;
+			a += b;
+		}
+	}
+
+	ex.run([&](unsigned int w) {
+		size_t *pos = histograms.data() + (size_t(w) * wc + col) * hist_len;
+		for (size_t i = chunk_begin(w) ; i < chunk_begin(w + 1) ; ++i) {
+			dst[pos[(kf(src[i]) >> shift) & 0xFF]++] = src[i];
+		}
+	});
+	return n_unordered;
+}
+
+// Sorts src, like radix_sort, on the workers of ex, see above and radix_sort_executor.hpp.
+// The default executor starts the tuned default number of threads, see rs_num_threads.
+//
+// Returns a pointer to the sorted entries, which are in src if it was already sorted,
+// otherwise in aux. Inputs of at most rs_msd_task_n entries, or with one worker, are
+// sorted by radix_sort instead, which may return either.
+template<typename T, typename KeyFunc = basic_kdfs::kdf_object, typename Executor = rs_executor_threads, typename Alloc = rs_alloc_malloc>
+T* radix_sort_msd_parallel(T* RESTRICT src, T* RESTRICT aux, size_t n, KeyFunc && kf = KeyFunc(), const Executor& ex = Executor(), const Alloc& alloc = Alloc()) {
+	const unsigned int workers = ex.workers();
+	if (n <= rs_msd_task_n || workers < 2)
+		return radix_sort(src, aux, n, kf, alloc);
+
+	std::array<size_t, 257> offsets;
+	if (rs_msd_partition_parallel(src, aux, n, kf, ex, offsets.data()) == 0)
+		return src;
+
+	// The results all go to aux. Buckets that are sorted in src are copied over.
+	auto finish = [aux](const rs_msd_task& task, const T* res) {
+		if (res != aux + task.begin)
+			std::copy(res, res + task.n, aux + task.begin);
+	};
+	auto add_buckets = [](std::vector<rs_msd_task>& tasks, const rs_msd_task& parent, const size_t *offs) {
+		for (unsigned int j = 0 ; j < 256 ; ++j) {
+			if (offs[j + 1] > offs[j])
+				tasks.push_back({ parent.begin + offs[j], offs[j + 1] - offs[j], !parent.in_aux });
+		}
+	};
+
+	std::vector<rs_msd_task> tasks;
+	add_buckets(tasks, rs_msd_task { 0, n, false }, offsets.data());
+
+	// Partition the buckets larger than a worker's share with all workers, until none are left.
+	auto by_size = [](const rs_msd_task& a, const rs_msd_task& b) { return a.n > b.n; };
+	std::sort(tasks.begin(), tasks.end(), by_size);
+	while (!tasks.empty() && tasks[0].n > std::max(n / workers, rs_msd_task_n)) {
+		rs_msd_task big = tasks[0];
+		tasks.erase(tasks.begin());
+		T *from = (big.in_aux ? aux : src) + big.begin;
+		T *to = (big.in_aux ? src : aux) + big.begin;
+		if (rs_msd_partition_parallel(from, to, big.n, kf, ex, offsets.data()) == 0) {
+			finish(big, from);
+			continue;
+		}
+		add_buckets(tasks, big, offsets.data());
+		std::sort(tasks.begin(), tasks.end(), by_size);
+	}
+
+	rs_run_tasks(ex, tasks, [&](const rs_msd_task& task, unsigned int, auto && push) {
+		T *from = (task.in_aux ? aux : src) + task.begin;
+		T *to = (task.in_aux ? src : aux) + task.begin;
+		if (task.n <= rs_msd_task_n) {
+			finish(task, radix_sort(from, to, task.n, kf, alloc));
+			return;
+		}
+		std::array<size_t, 257> offs;
+		if (rs_msd_partition(from, to, task.n, kf, offs.data()) == 0) {
+			finish(task, to);
+			return;
+		}
+		for (unsigned int j = 0 ; j < 256 ; ++j) {
+			if (offs[j + 1] > offs[j])
+				push(rs_msd_task { task.begin + offs[j], offs[j + 1] - offs[j], !task.in_aux });
+		}
+	});
+
+	return aux;
+}
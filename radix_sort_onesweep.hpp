@@ -0,0 +1,187 @@
+/*
+	Parallel LSD radix sort with a single histogram pass, after Onesweep.
+
+	Adinets and Merrill, "Onesweep: A Faster Least Significant Digit Radix Sort for GPUs", 2022.
+	https://arxiv.org/abs/2206.01784
+
+	A parallel LSD sort that splits each pass into chunks has to know where each chunk's
+	entries go, i.e the counts of all the chunks before it, so it usually histograms the
+	chunks before every scatter, reading the input twice per pass.
+
+	Here the histograms of all the key bytes are built up front, in one parallel pass, as
+	rs_sort_main does serially. They give the global offset of every bucket, for every pass.
+	What's left is the offset within the bucket, which is the sum of the counts of the earlier
+	tiles. That comes from decoupled look-back: each tile of the input, taken in order by
+	whichever worker is free, counts its own digits, and publishes the counts. It then walks
+	back over the earlier tiles, summing their counts, until it reaches one that has published
+	its inclusive prefix, i.e the sum of its own and all earlier counts, and publishes its own.
+	The tile is then scattered, while it's still in cache.
+
+	So each pass reads and writes the entries once. A tile only waits for the tiles before it
+	to count their digits, never for a barrier across all tiles. There is one barrier between
+	passes, as the next pass reads the output of the previous.
+
+	See https://github.com/eloj/radix-sorting#onesweep
+*/
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cinttypes>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "radix_sort.hpp"
+#include "radix_sort_executor.hpp"
+
+// Look-back status of one tile and bucket: the pass it belongs to, whether the value is the
+// tile's own count (aggregate) or its inclusive prefix, and the value. Statuses of earlier
+// passes are taken for not yet published, so the buffer doesn't need clearing between passes.
+constexpr unsigned int rs_onesweep_value_bits = 48;
+constexpr uint64_t rs_onesweep_value_mask = (1ULL << rs_onesweep_value_bits) - 1;
+constexpr uint64_t rs_onesweep_inclusive = 1ULL << rs_onesweep_value_bits;
+
+inline uint64_t rs_onesweep_status(unsigned int pass, bool inclusive, uint64_t value) {
+	return (uint64_t(pass + 1) << (rs_onesweep_value_bits + 1)) | (inclusive ? rs_onesweep_inclusive : 0) | value;
+}
+
+inline bool rs_onesweep_published(uint64_t status, unsigned int pass) {
+	return (status >> (rs_onesweep_value_bits + 1)) == pass + 1;
+}
+
+// One scatter pass over tile t of src, on the key byte at shift.
+template<typename T, typename KeyFunc>
+void rs_onesweep_tile(const T* RESTRICT src, T* RESTRICT dst, size_t n, size_t t, unsigned int pass, unsigned int shift, KeyFunc && kf, const size_t *offsets, uint64_t *status, uint8_t *digits) {
+	constexpr unsigned int hist_len = 256;
+	size_t start = t * rs_onesweep_tile_n;
+	size_t len = std::min(rs_onesweep_tile_n, n - start);
+
+	std::array<size_t, hist_len> counts{0};
+	for (size_t i = 0 ; i < len ; ++i) {
+		digits[i] = (kf(src[start + i]) >> shift) & 0xFF;
+		++counts[digits[i]];
+	}
+
+	// Publish the counts. The first tile's are also its inclusive prefix.
+	uint64_t *own = status + t * hist_len;
+	for (unsigned int b = 0 ; b < hist_len ; ++b) {
+		__atomic_store_n(own + b, rs_onesweep_status(pass, t == 0, counts[b]), __ATOMIC_RELEASE);
+	}
+
+	// Look back, for the number of entries of each bucket in the earlier tiles.
+	std::array<size_t, hist_len> pos;
+	for (unsigned int b = 0 ; b < hist_len ; ++b) {
+		size_t prefix = 0;
+		for (size_t p = t ; p-- > 0 ; ) {
+			uint64_t s;
+			while (!rs_onesweep_published(s = __atomic_load_n(status + p * hist_len + b, __ATOMIC_ACQUIRE), pass)) {
+				std::this_thread::yield();
+			}
+			prefix += s & rs_onesweep_value_mask;
+			if (s & rs_onesweep_inclusive)
+				break;
+		}
+		if (t > 0)
+			__atomic_store_n(own + b, rs_onesweep_status(pass, true, prefix + counts[b]), __ATOMIC_RELEASE);
+		pos[b] = offsets[b] + prefix;
+	}
+
+	for (size_t i = 0 ; i < len ; ++i) {
+		dst[pos[digits[i]]++] = src[start + i];
+	}
+}
+
+// Sorts src, like radix_sort, on the workers of ex, see radix_sort_executor.hpp. A worker may
+// wait for another to count a tile, but only for one that's already claimed, by a worker that
+// is running, so running the workers one after the other still works.
+//
+// Returns a pointer to the sorted entries, which are in either src or aux. Inputs of at
+// most two tiles, see RS_TUNE_ONESWEEP_TILE_N, or with one worker, are sorted by radix_sort,
+// as are all inputs if the look-back buffer could not be allocated.
+template<typename T, typename KeyFunc = basic_kdfs::kdf_object, typename Executor = rs_executor_threads, typename Alloc = rs_alloc_malloc>
+T* radix_sort_onesweep(T* RESTRICT src, T* RESTRICT aux, size_t n, KeyFunc && kf = KeyFunc(), const Executor& ex = Executor(), const Alloc& alloc = Alloc()) {
+	typedef typename std::result_of_t<KeyFunc&&(T)> KeyType;
+	constexpr uint8_t byte_mask = rs_byte_mask_v<KeyFunc, KeyType>;
+	constexpr size_t wc = rs_popcount(byte_mask);
+	constexpr std::array<uint8_t, 8> shift_table = rs_mask_shifts(byte_mask);
+	constexpr unsigned int hist_len = 256;
+	constexpr bool descending = rs_descending_v<KeyFunc>;
+	const unsigned int workers = ex.workers();
+	const size_t ntiles = (n + rs_onesweep_tile_n - 1) / rs_onesweep_tile_n;
+
+	if (ntiles <= 2 || workers < 2 || n > rs_onesweep_value_mask)
+		return radix_sort(src, aux, n, kf, alloc);
+
+	// Per worker: the digits of a tile. Shared: the look-back statuses.
+	size_t status_bytes = sizeof(uint64_t) * hist_len * ntiles;
+	size_t digits_bytes = rs_onesweep_tile_n * workers;
+	uint64_t *status = static_cast<uint64_t*>(alloc.allocate(status_bytes));
+	uint8_t *digits = static_cast<uint8_t*>(alloc.allocate(digits_bytes));
+	auto release = [&]() {
+		alloc.deallocate(status, status_bytes);
+		alloc.deallocate(digits, digits_bytes);
+	};
+	if (!status || !digits) {
+		release();
+		return radix_sort(src, aux, n, kf, alloc);
+	}
+	std::memset(status, 0, status_bytes);
+
+	// The histograms of all passes, one chunk per worker, and pre-sorted detection.
+	auto chunk_begin = [n, workers](size_t w) { return n * w / workers; };
+	std::vector<std::array<size_t, hist_len * wc>> histograms(workers);
+	std::vector<size_t> unordered(workers);
+	ex.run([&](unsigned int w) {
+		size_t start = chunk_begin(w);
+		size_t end = chunk_begin(w + 1);
+		histograms[w].fill(0);
+		unordered[w] = rs_histogram(src + start, end - start, histograms[w], kf);
+		if (start < end && end < n && !rs_key_in_order<KeyFunc>(kf(src[end - 1]), kf(src[end])))
+			++unordered[w];
+	});
+	std::array<size_t, hist_len * wc> histogram{0};
+	size_t n_unordered = 0;
+	for (unsigned int w = 0 ; w < workers ; ++w) {
+		for (size_t i = 0 ; i < hist_len * wc ; ++i) {
+			histogram[i] += histograms[w][i];
+		}
+		n_unordered += unordered[w];
+	}
+	if (n_unordered == 0) {
+		release();
+		return src;
+	}
+
+	// Column skipping, and the global bucket offsets, as in rs_sort_from_histogram.
+	KeyType key0 = kf(*src);
+	unsigned int cols[wc];
+	unsigned int ncols = 0;
+	for (unsigned int i = 0 ; i < wc ; ++i) {
+		if (histogram[(hist_len*i) + ((key0 >> shift_table[i]) & 0xFF)] != n)
+			cols[ncols++] = i;
+	}
+	for (unsigned int i = 0 ; i < ncols ; ++i) {
+		size_t a = 0;
+		for (unsigned int j = 0 ; j < hist_len ; ++j) {
+			unsigned int bucket = descending ? hist_len - 1 - j : j;
+			size_t b = histogram[(hist_len*cols[i]) + bucket];
+			histogram[(hist_len*cols[i]) + bucket] = a;
+			a += b;
+		}
+	}
+
+	for (unsigned int i = 0 ; i < ncols ; ++i) {
+		std::atomic<size_t> next { 0 };
+		ex.run([&](unsigned int w) {
+			for (size_t t = next++ ; t < ntiles ; t = next++) {
+				rs_onesweep_tile(src, aux, n, t, i, shift_table[cols[i]], kf, histogram.data() + hist_len * cols[i], status, digits + rs_onesweep_tile_n * w);
+			}
+		});
+		std::swap(src, aux);
+	}
+
+	release();
+	return src;
+}
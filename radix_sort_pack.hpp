@@ -0,0 +1,287 @@
+/*
+	Compressing sorted integers, with delta encoding and bit-packing.
+
+	The differences between consecutive sorted keys are small, and often much smaller than
+	the keys, so a sorted array of IDs written to disk or sent over the network can usually
+	be stored in a fraction of the space.
+
+	The values are encoded in blocks of 128. Each block stores the differences between its
+	values and the ones before them, in as many bits as the largest one needs, after a one
+	byte header giving that width. The differences are packed in four 32-bit lanes, value i
+	going to lane i % 4, so that four are packed or unpacked at once with SSE2, after
+	"SIMD-BP128" in Lemire and Boytsov, "Decoding billions of integers per second through
+	vectorization", 2012. https://arxiv.org/abs/1209.2137
+
+	Differences wider than 32 bits are split, the low 32 bits being packed first, then the
+	rest. The last block, of less than 128 values, is packed one value after the other,
+	without lanes, so that short arrays don't pay for a full block.
+
+	See https://github.com/eloj/radix-sorting#packing
+*/
+#pragma once
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+#include <type_traits>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifndef RESTRICT
+#define RESTRICT __restrict__
+#endif
+
+constexpr size_t rs_pack_block_n = 128;
+
+// Largest size, in bytes, of n encoded values of type T.
+template<typename T>
+constexpr size_t rs_pack_bound(size_t n) {
+	return (n + rs_pack_block_n - 1) / rs_pack_block_n * (1 + rs_pack_block_n * sizeof(T));
+}
+
+// Packs the 128 values of in, each less than 2^bits, into 16 * bits bytes of out.
+inline void rs_pack_lanes(const uint32_t* RESTRICT in, unsigned int bits, uint8_t* RESTRICT out) {
+	if (bits == 0)
+		return;
+#ifdef __SSE2__
+	__m128i *dst = reinterpret_cast<__m128i*>(out);
+	__m128i acc = _mm_setzero_si128();
+	unsigned int fill = 0;
+	for (size_t j = 0 ; j < rs_pack_block_n / 4 ; ++j) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in) + j);
+		acc = _mm_or_si128(acc, _mm_sll_epi32(v, _mm_cvtsi32_si128(fill)));
+		fill += bits;
+		if (fill >= 32) {
+			_mm_storeu_si128(dst++, acc);
+			fill -= 32;
+			// The bits that didn't fit. Shifts by 32 give zero.
+			acc = _mm_srl_epi32(v, _mm_cvtsi32_si128(bits - fill));
+		}
+	}
+#else
+	uint32_t acc[4] = { 0 };
+	unsigned int fill = 0;
+	for (size_t j = 0 ; j < rs_pack_block_n / 4 ; ++j) {
+		for (size_t k = 0 ; k < 4 ; ++k) {
+			acc[k] |= fill < 32 ? in[j * 4 + k] << fill : 0;
+		}
+		fill += bits;
+		if (fill >= 32) {
+			std::memcpy(out, acc, sizeof(acc));
+			out += sizeof(acc);
+			fill -= 32;
+			for (size_t k = 0 ; k < 4 ; ++k) {
+				acc[k] = bits - fill < 32 ? in[j * 4 + k] >> (bits - fill) : 0;
+			}
+		}
+	}
+#endif
+}
+
+// Unpacks the 128 values of rs_pack_lanes from 16 * bits bytes of in.
+inline void rs_unpack_lanes(const uint8_t* RESTRICT in, unsigned int bits, uint32_t* RESTRICT out) {
+	if (bits == 0) {
+		std::fill(out, out + rs_pack_block_n, 0);
+		return;
+	}
+#ifdef __SSE2__
+	const __m128i *src = reinterpret_cast<const __m128i*>(in);
+	const __m128i mask = _mm_set1_epi32(bits == 32 ? ~0U : (1U << bits) - 1);
+	__m128i cur = _mm_loadu_si128(src++);
+	unsigned int fill = 0;
+	for (size_t j = 0 ; j < rs_pack_block_n / 4 ; ++j) {
+		__m128i v = _mm_srl_epi32(cur, _mm_cvtsi32_si128(fill));
+		fill += bits;
+		if (fill > 32) {
+			cur = _mm_loadu_si128(src++);
+			fill -= 32;
+			v = _mm_or_si128(v, _mm_sll_epi32(cur, _mm_cvtsi32_si128(bits - fill)));
+		} else if (fill == 32 && j + 1 < rs_pack_block_n / 4) {
+			cur = _mm_loadu_si128(src++);
+			fill = 0;
+		}
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out) + j, _mm_and_si128(v, mask));
+	}
+#else
+	const uint32_t mask = bits == 32 ? ~0U : (1U << bits) - 1;
+	uint32_t cur[4];
+	std::memcpy(cur, in, sizeof(cur));
+	in += sizeof(cur);
+	unsigned int fill = 0;
+	for (size_t j = 0 ; j < rs_pack_block_n / 4 ; ++j) {
+		uint32_t v[4];
+		for (size_t k = 0 ; k < 4 ; ++k) {
+			v[k] = fill < 32 ? cur[k] >> fill : 0;
+		}
+		fill += bits;
+		if (fill > 32) {
+			std::memcpy(cur, in, sizeof(cur));
+			in += sizeof(cur);
+			fill -= 32;
+			for (size_t k = 0 ; k < 4 ; ++k) {
+				v[k] |= cur[k] << (bits - fill);
+			}
+		} else if (fill == 32 && j + 1 < rs_pack_block_n / 4) {
+			std::memcpy(cur, in, sizeof(cur));
+			in += sizeof(cur);
+			fill = 0;
+		}
+		for (size_t k = 0 ; k < 4 ; ++k) {
+			out[j * 4 + k] = v[k] & mask;
+		}
+	}
+#endif
+}
+
+// Bits needed for the largest of the n deltas, which is at most any.
+inline unsigned int rs_pack_width(uint64_t any) {
+	return any ? 64 - __builtin_clzll(any) : 0;
+}
+
+// Packs a full block of deltas in lanes, the low 32 bits of each, then the rest.
+// Returns the number of bytes written, 16 * bits.
+template<typename T>
+size_t rs_pack_block(const T* RESTRICT deltas, unsigned int bits, uint8_t* RESTRICT out) {
+	if constexpr (sizeof(T) == 4) {
+		rs_pack_lanes(deltas, bits, out);
+		return rs_pack_block_n / 8 * bits;
+	}
+	uint32_t lanes[rs_pack_block_n];
+	std::copy(deltas, deltas + rs_pack_block_n, lanes);
+	rs_pack_lanes(lanes, std::min(bits, 32U), out);
+	if (bits > 32) {
+		for (size_t j = 0 ; j < rs_pack_block_n ; ++j) {
+			lanes[j] = uint64_t(deltas[j]) >> 32;
+		}
+		rs_pack_lanes(lanes, bits - 32, out + rs_pack_block_n / 8 * 32);
+	}
+	return rs_pack_block_n / 8 * bits;
+}
+
+template<typename T>
+void rs_unpack_block(const uint8_t* RESTRICT in, unsigned int bits, T* RESTRICT deltas) {
+	if constexpr (sizeof(T) == 4) {
+		rs_unpack_lanes(in, bits, deltas);
+		return;
+	}
+	uint32_t lanes[rs_pack_block_n];
+	rs_unpack_lanes(in, std::min(bits, 32U), lanes);
+	std::copy(lanes, lanes + rs_pack_block_n, deltas);
+	if (bits > 32) {
+		rs_unpack_lanes(in + rs_pack_block_n / 8 * 32, bits - 32, lanes);
+		for (size_t j = 0 ; j < rs_pack_block_n ; ++j) {
+			deltas[j] |= T(uint64_t(lanes[j]) << 32);
+		}
+	}
+}
+
+// Packs the m deltas of a partial block one after the other, least significant bit first.
+// Returns the number of bytes written, m * bits / 8 rounded up.
+template<typename T>
+size_t rs_pack_tail(const T* RESTRICT deltas, size_t m, unsigned int bits, uint8_t* RESTRICT out) {
+	uint8_t *start = out;
+	uint64_t acc = 0;
+	unsigned int fill = 0;
+	auto put = [&](uint32_t v, unsigned int b) {
+		acc |= uint64_t(v) << fill;
+		for (fill += b ; fill >= 8 ; fill -= 8) {
+			*out++ = acc;
+			acc >>= 8;
+		}
+	};
+	for (size_t j = 0 ; j < m ; ++j) {
+		put(deltas[j], std::min(bits, 32U));
+		if (bits > 32)
+			put(uint64_t(deltas[j]) >> 32, bits - 32);
+	}
+	if (fill)
+		*out++ = acc;
+	return out - start;
+}
+
+template<typename T>
+void rs_unpack_tail(const uint8_t* RESTRICT in, size_t m, unsigned int bits, T* RESTRICT deltas) {
+	uint64_t acc = 0;
+	unsigned int fill = 0;
+	auto get = [&](unsigned int b) -> uint64_t {
+		for ( ; fill < b ; fill += 8) {
+			acc |= uint64_t(*in++) << fill;
+		}
+		uint64_t v = acc & ((1ULL << b) - 1);
+		acc >>= b;
+		fill -= b;
+		return v;
+	};
+	for (size_t j = 0 ; j < m ; ++j) {
+		deltas[j] = get(std::min(bits, 32U));
+		if (bits > 32)
+			deltas[j] |= T(get(bits - 32) << 32);
+	}
+}
+
+// Encodes the n values of src, which must be sorted in ascending order, into dst, which must
+// hold rs_pack_bound<T>(n) bytes. The count is not stored. base is the value before src[0],
+// so a long array can be encoded in chunks, each with the last value of the one before, and
+// decoded with the same chunks.
+//
+// Returns the number of bytes written, or zero if src is not sorted.
+template<typename T>
+size_t radix_pack_sorted(const T* RESTRICT src, size_t n, uint8_t* RESTRICT dst, T base = 0) {
+	static_assert(std::is_same_v<T, uint32_t> || std::is_same_v<T, uint64_t>, "T must be uint32_t or uint64_t");
+	uint8_t *out = dst;
+	T prev = base;
+
+	for (size_t i = 0 ; i < n ; i += rs_pack_block_n) {
+		size_t m = std::min(rs_pack_block_n, n - i);
+		T deltas[rs_pack_block_n];
+		T any = 0;
+		bool unordered = false;
+		for (size_t j = 0 ; j < m ; ++j) {
+			unordered |= src[i + j] < prev;
+			deltas[j] = src[i + j] - prev;
+			any |= deltas[j];
+			prev = src[i + j];
+		}
+		if (unordered)
+			return 0;
+
+		unsigned int bits = rs_pack_width(any);
+		*out++ = bits;
+		out += m == rs_pack_block_n ? rs_pack_block(deltas, bits, out) : rs_pack_tail(deltas, m, bits, out);
+	}
+	return out - dst;
+}
+
+// Decodes n values, encoded by radix_pack_sorted with the same base, from the src_bytes
+// bytes of src into dst.
+//
+// Returns the number of bytes read, or zero if src is truncated or corrupt.
+template<typename T>
+size_t radix_unpack_sorted(const uint8_t* RESTRICT src, size_t src_bytes, size_t n, T* RESTRICT dst, T base = 0) {
+	static_assert(std::is_same_v<T, uint32_t> || std::is_same_v<T, uint64_t>, "T must be uint32_t or uint64_t");
+	const uint8_t *in = src;
+	const uint8_t *end = src + src_bytes;
+	T prev = base;
+
+	for (size_t i = 0 ; i < n ; i += rs_pack_block_n) {
+		size_t m = std::min(rs_pack_block_n, n - i);
+		if (in == end)
+			return 0;
+		unsigned int bits = *in++;
+		size_t bytes = (m * bits + 7) / 8;
+		if (bits > sizeof(T) * 8 || size_t(end - in) < bytes)
+			return 0;
+
+		T deltas[rs_pack_block_n];
+		if (m == rs_pack_block_n)
+			rs_unpack_block(in, bits, deltas);
+		else
+			rs_unpack_tail(in, m, bits, deltas);
+		in += bytes;
+		for (size_t j = 0 ; j < m ; ++j) {
+			dst[i + j] = prev += deltas[j];
+		}
+	}
+	return in - src;
+}
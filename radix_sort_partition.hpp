@@ -0,0 +1,200 @@
+/*
+	Radix partitioning: one stable counting sort pass on a bit field of the key.
+
+	Splitting an array into 2^bits partitions on the key bits [shift, shift + bits) is the
+	building block of radix hash joins, and of sharding work by key. It is the scatter of
+	counting_sort_rec_sk.c, with a fan-out from 2^4 to 2^14.
+
+	With a large fan-out, the scatter writes to more streams than the cache and TLB can
+	track, and each entry written costs a read of its cache line. So the entries are first
+	gathered in one cache line sized buffer per partition, and each full buffer is written
+	out as a whole, aligned, line, with non-temporal stores where available ("software
+	write-combining"). The first line of each partition is only partly written, so that
+	the rest are aligned. See RS_TUNE_PARTITION_WC_MIN_BITS for when this pays off.
+
+	The input is split between the threads. Each thread builds a histogram of its part,
+	and scatters it to its own ranges of the partitions, so the output is stable.
+
+	See https://github.com/eloj/radix-sorting#partitioning
+*/
+#pragma once
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "radix_sort.hpp"
+#include "radix_sort_executor.hpp"
+
+constexpr unsigned int rs_partition_min_bits = 4;
+constexpr unsigned int rs_partition_max_bits = 14;
+
+// Entries per write-combining buffer, or zero if T does not pack into a cache line.
+template<typename T>
+constexpr size_t rs_partition_line_n = (rs_cacheline % sizeof(T) == 0 && sizeof(T) <= rs_cacheline / 2) ? rs_cacheline / sizeof(T) : 0;
+
+// Histogram of the partitions of src[0..n).
+template<typename T, typename PartFunc>
+void rs_partition_count(const T* src, size_t n, PartFunc && part_of, size_t *counts) {
+	for (size_t i = 0 ; i < n ; ++i) {
+		++counts[part_of(src[i])];
+	}
+}
+
+// Scatter of src[0..n) to dst, partition p starting at pos[p].
+template<typename T, typename PartFunc>
+void rs_partition_scatter(const T* RESTRICT src, T* RESTRICT dst, size_t n, PartFunc && part_of, size_t *pos) {
+	for (size_t i = 0 ; i < n ; ++i) {
+		dst[pos[part_of(src[i])]++] = src[i];
+	}
+}
+
+// Copies one cache line to an aligned destination, bypassing the cache if possible.
+inline void rs_stream_line(void* RESTRICT dst, const void* RESTRICT src) {
+#ifdef __SSE2__
+	for (size_t i = 0 ; i < rs_cacheline / 16 ; ++i) {
+		_mm_stream_si128(static_cast<__m128i*>(dst) + i, _mm_load_si128(static_cast<const __m128i*>(src) + i));
+	}
+#else
+	std::memcpy(dst, src, rs_cacheline);
+#endif
+}
+
+// Index of the first entry of the line at base that belongs to the partition starting at
+// begin; non-zero only for its first line.
+template<size_t L>
+inline size_t rs_partition_line_lo(size_t base, size_t begin) {
+	size_t lo = begin - base;
+	return lo < L ? lo : 0;
+}
+
+// Scatter through write-combining buffers, one line per partition in buf, which must be
+// cache line aligned, as must dst be to sizeof(T). base[p] is the output index of the first entry of p's buffer, and
+// partition p's output starts at begin[p]; entries below that are not written. base[p]
+// may wrap below zero for the first line, so it's only ever used as base[p] + lo.
+template<typename T, typename PartFunc>
+void rs_partition_scatter_wc(const T* RESTRICT src, T* RESTRICT dst, size_t n, size_t fan, PartFunc && part_of, const size_t *begin, T* RESTRICT buf, size_t *base, size_t *fill) {
+	constexpr size_t L = rs_partition_line_n<T>;
+	for (size_t p = 0 ; p < fan ; ++p) {
+		fill[p] = (reinterpret_cast<uintptr_t>(dst + begin[p]) % rs_cacheline) / sizeof(T);
+		base[p] = begin[p] - fill[p];
+	}
+
+	for (size_t i = 0 ; i < n ; ++i) {
+		size_t p = part_of(src[i]);
+		T *line = buf + p * L;
+		line[fill[p]++] = src[i];
+		if (fill[p] == L) {
+			size_t lo = rs_partition_line_lo<L>(base[p], begin[p]);
+			if (lo == 0) {
+				rs_stream_line(dst + base[p], line);
+			} else {
+				std::memcpy(dst + (base[p] + lo), line + lo, sizeof(T) * (L - lo));
+			}
+			base[p] += L;
+			fill[p] = 0;
+		}
+	}
+
+	for (size_t p = 0 ; p < fan ; ++p) {
+		size_t lo = rs_partition_line_lo<L>(base[p], begin[p]);
+		if (fill[p] > lo)
+			std::memcpy(dst + (base[p] + lo), buf + p * L + lo, sizeof(T) * (fill[p] - lo));
+	}
+#ifdef __SSE2__
+	// The streamed stores are weakly ordered.
+	_mm_sfence();
+#endif
+}
+
+// Partitions src into dst on the key bits [shift, shift + bits), which must be within
+// the key, with bits from rs_partition_min_bits to rs_partition_max_bits. The order of
+// the partitions follows the KDF, so it's reversed for descending KDFs, and the order
+// within each partition is that of src. A thread count of zero means the tuned default.
+//
+// Returns the 2^bits + 1 offsets of the partitions in dst, partition p being
+// dst[offsets[p]] .. dst[offsets[p+1] - 1], or an empty vector if bits is out of range
+// or the buffers could not be allocated.
+template<typename T, typename KeyFunc = basic_kdfs::kdf_object, typename Alloc = rs_alloc_malloc>
+std::vector<size_t> radix_partition(const T* RESTRICT src, T* RESTRICT dst, size_t n, unsigned int bits, unsigned int shift, KeyFunc && kf = KeyFunc(), unsigned int threads = 0, const Alloc& alloc = Alloc()) {
+	static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+	typedef typename std::result_of_t<KeyFunc&&(T)> KeyType;
+	constexpr size_t L = rs_partition_line_n<T>;
+
+	if (bits < rs_partition_min_bits || bits > rs_partition_max_bits || shift + bits > sizeof(KeyType) * 8)
+		return {};
+
+	const size_t fan = size_t(1) << bits;
+	const size_t mask = fan - 1;
+	auto part_of = [&kf, shift, mask](const T& v) -> size_t {
+		size_t p = (kf(v) >> shift) & mask;
+		return rs_descending_v<KeyFunc> ? mask - p : p;
+	};
+
+	threads = rs_num_threads(threads, n);
+	// Per thread: a histogram, which becomes the output positions, and the buffers.
+	std::vector<size_t> counts(fan * threads);
+	// The lines are only aligned if dst is aligned to the entry size, which may be more than alignof(T).
+	bool wc = L > 0 && bits >= rs_partition_wc_min_bits && n >= rs_partition_wc_min_n && reinterpret_cast<uintptr_t>(dst) % sizeof(T) == 0;
+	std::vector<size_t> state(wc ? fan * threads * 2 : 0);
+	size_t buf_bytes = wc ? sizeof(T) * L * fan + rs_cacheline : 0;
+	std::vector<void*> mem(threads);
+	bool ok = true;
+	for (unsigned int t = 0 ; t < threads && wc ; ++t) {
+		mem[t] = alloc.allocate(buf_bytes);
+		ok = ok && mem[t];
+	}
+	auto release = [&]() {
+		for (unsigned int t = 0 ; t < threads && wc ; ++t) {
+			alloc.deallocate(mem[t], buf_bytes);
+		}
+	};
+	if (!ok) {
+		release();
+		return {};
+	}
+
+	auto chunk_begin = [n, threads](size_t t) { return n * t / threads; };
+	rs_executor_threads ex { threads };
+
+	ex.run([&](unsigned int t) {
+		size_t start = chunk_begin(t);
+		rs_partition_count(src + start, chunk_begin(t + 1) - start, part_of, counts.data() + t * fan);
+	});
+
+	// Exclusive scan in partition-major, thread-minor order.
+	std::vector<size_t> offsets(fan + 1);
+	size_t a = 0;
+	for (size_t p = 0 ; p < fan ; ++p) {
+		offsets[p] = a;
+		for (unsigned int t = 0 ; t < threads ; ++t) {
+			size_t b = counts[t * fan + p];
+			counts[t * fan + p] = a;
+			a += b;
+		}
+	}
+	offsets[fan] = a;
+
+	ex.run([&](unsigned int t) {
+		size_t start = chunk_begin(t);
+		size_t len = chunk_begin(t + 1) - start;
+		size_t *pos = counts.data() + t * fan;
+		if constexpr (L > 0) {
+			if (wc) {
+				uintptr_t addr = reinterpret_cast<uintptr_t>(mem[t]);
+				T *buf = reinterpret_cast<T*>((addr + rs_cacheline - 1) / rs_cacheline * rs_cacheline);
+				size_t *st = state.data() + t * fan * 2;
+				rs_partition_scatter_wc(src + start, dst, len, fan, part_of, pos, buf, st, st + fan);
+				return;
+			}
+		}
+		rs_partition_scatter(src + start, dst, len, part_of, pos);
+	});
+
+	release();
+	return offsets;
+}
@@ -0,0 +1,96 @@
+/*
+	Applying a rank permutation, i.e the output of radix_sort_rank, to an array.
+
+	See https://github.com/eloj/radix-sorting#by-rank
+*/
+#pragma once
+
+#include <algorithm>
+#include <cinttypes>
+#include <thread>
+#include <vector>
+
+#include "radix_sort_config.hpp"
+
+#ifndef RESTRICT
+#define RESTRICT __restrict__
+#endif
+
+// Gather kernel: dst[i] = src[idx_of(i)]
+//
+// The output is written sequentially in blocks. The (random) reads of the next
+// block are prefetched while the current block is copied, so that up to a block's
+// worth of cache misses are in flight at any time.
+template<typename T, typename IdxFunc>
+void rs_gather(const T* RESTRICT src, T* RESTRICT dst, size_t n, IdxFunc && idx_of) {
+	constexpr size_t block = 32;
+	for (size_t i = 0 ; i < n ; i += block) {
+		size_t end = std::min(n, i + block);
+		size_t pf_end = std::min(n, end + block);
+		for (size_t j = end ; j < pf_end ; ++j) {
+			__builtin_prefetch(src + idx_of(j));
+		}
+		for (size_t j = i ; j < end ; ++j) {
+			dst[j] = src[idx_of(j)];
+		}
+	}
+}
+
+// Out-of-place: dst[i] = src[ranks[i]]
+template<typename T, typename IdxType>
+T* rs_apply_rank(const T* RESTRICT src, T* RESTRICT dst, const IdxType* RESTRICT ranks, size_t n) {
+	rs_gather(src, dst, n, [ranks](size_t i) -> size_t { return ranks[i]; });
+	return dst;
+}
+
+// Out-of-place, multi-threaded. The output is split into one contiguous range per thread.
+// A thread count of zero means use the tuned default, see radix_sort_config.hpp.
+template<typename T, typename IdxType>
+T* rs_apply_rank_parallel(const T* RESTRICT src, T* RESTRICT dst, const IdxType* RESTRICT ranks, size_t n, unsigned int threads = 0) {
+	threads = rs_num_threads(threads, n);
+
+	if (threads < 2)
+		return rs_apply_rank(src, dst, ranks, n);
+
+	std::vector<std::thread> workers;
+	size_t chunk = (n + threads - 1) / threads;
+	for (size_t start = 0 ; start < n ; start += chunk) {
+		size_t len = std::min(chunk, n - start);
+		workers.emplace_back([=]() {
+			rs_gather(src, dst + start, len, [ranks, start](size_t i) -> size_t { return ranks[start + i]; });
+		});
+	}
+	for (auto& w : workers) {
+		w.join();
+	}
+
+	return dst;
+}
+
+// In-place: arr[i] = arr[ranks[i]], by following the cycles of the permutation.
+//
+// Only one element of temporary storage is used, but the ranks are overwritten,
+// and left as the identity permutation. Each step of a cycle prefetches the
+// element needed by the next step.
+template<typename T, typename IdxType>
+T* rs_apply_rank_inplace(T* RESTRICT arr, IdxType* RESTRICT ranks, size_t n) {
+	for (size_t i = 0 ; i < n ; ++i) {
+		if (static_cast<size_t>(ranks[i]) == i)
+			continue;
+
+		T tmp = std::move(arr[i]);
+		size_t j = i;
+		size_t k = ranks[j];
+		while (k != i) {
+			size_t next = ranks[k];
+			__builtin_prefetch(arr + next);
+			arr[j] = std::move(arr[k]);
+			ranks[j] = j;
+			j = k;
+			k = next;
+		}
+		arr[j] = std::move(tmp);
+		ranks[j] = j;
+	}
+	return arr;
+}
@@ -0,0 +1,38 @@
+/*
+	Prefetch policies for the histogram and scatter loops.
+
+	A policy is called once per element as pf(i, n, addr_of), where i is the
+	current position of the loop, n its length, and addr_of(j) returns the
+	address of the j:th element in loop order.
+
+	See https://github.com/eloj/radix-sorting#prefetching
+*/
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+
+#include "radix_sort_config.hpp"
+
+// No prefetching. This is the default, and compiles to nothing.
+struct rs_prefetch_none {
+	template<typename Addr>
+	void operator()(size_t, size_t, Addr &&) const { }
+};
+
+// Prefetch the element 2*distance ahead. If the elements are pointers, also
+// prefetch the object pointed to by the element distance ahead, which
+// should be in cache by then, for the benefit of KDFs that dereference it.
+struct rs_prefetch {
+	size_t distance = rs_prefetch_distance;
+
+	template<typename Addr>
+	void operator()(size_t i, size_t n, Addr && addr_of) const {
+		if (i + 2 * distance < n)
+			__builtin_prefetch(addr_of(i + 2 * distance));
+		if constexpr (std::is_pointer_v<std::remove_cv_t<std::remove_pointer_t<decltype(addr_of(i))>>>) {
+			if (i + distance < n)
+				__builtin_prefetch(*addr_of(i + distance));
+		}
+	}
+};
@@ -14,13 +14,17 @@
 #include <cstring> // for std::memcpy
 
 #include "radix_sort_basic_kdf.hpp"
+#include "radix_sort_prefetch.hpp"
 
 #ifndef RESTRICT
 #define RESTRICT __restrict__
 #endif
 
-template<typename T, typename KeyFunc = decltype(basic_kdfs::kdf<T>), typename Hist, typename IdxType = size_t, typename KeyType=typename std::result_of_t<KeyFunc&&(T)>>
-IdxType* rs_sort_rank(const T* RESTRICT src, IdxType* RESTRICT index_buffer, size_t n, Hist& histogram, KeyFunc && kf = basic_kdfs::kdf) {
+// Prefetch is the prefetch policy used in the histogram and scatter loops. In the
+// latter the elements are visited in the order of the index buffer.
+// A KDF wrapped by basic_kdfs::descending gives the ranks in descending order.
+template<typename T, typename KeyFunc = decltype(basic_kdfs::kdf<T>), typename Hist, typename IdxType = size_t, typename KeyType=typename std::result_of_t<KeyFunc&&(T)>, typename Prefetch = rs_prefetch_none>
+IdxType* rs_sort_rank(const T* RESTRICT src, IdxType* RESTRICT index_buffer, size_t n, Hist& histogram, KeyFunc && kf = basic_kdfs::kdf, const Prefetch& pf = Prefetch()) {
 	typedef typename Hist::value_type HVT;
 	static_assert(sizeof(KeyType) <= 8, "KeyType must be 64-bits or less");
 	static_assert(std::is_unsigned<KeyType>(), "KeyType must be unsigned");
@@ -34,6 +38,7 @@ IdxType* rs_sort_rank(const T* RESTRICT src, IdxType* RESTRICT index_buffer, siz
 	constexpr size_t wc = sizeof(KeyType);
 	constexpr std::array<uint8_t, 8> shift_table = { 0, 8, 16, 24, 32, 40, 48, 56 };
 	constexpr unsigned int hist_len = 256;
+	constexpr bool descending = rs_descending_v<KeyFunc>;
 	unsigned int cols[wc];
 	unsigned int ncols = 0;
 	KeyType key0;
@@ -41,9 +46,10 @@ IdxType* rs_sort_rank(const T* RESTRICT src, IdxType* RESTRICT index_buffer, siz
 	// Histograms
 	size_t n_unsorted = n;
 	for (size_t i = 0 ; i < n ; ++i) {
+		pf(i, n, [src](size_t j) -> const T* { return src + j; });
 		// pre-sorted detection
 		key0 = kf(src[i]);
-		if ((i < n - 1) && (key0 <= kf(src[i+1]))) {
+		if ((i < n - 1) && (descending ? key0 >= kf(src[i+1]) : key0 <= kf(src[i+1]))) {
 			--n_unsorted;
 		}
 		for (unsigned int j = 0 ; j < wc ; ++j) {
@@ -64,22 +70,25 @@ IdxType* rs_sort_rank(const T* RESTRICT src, IdxType* RESTRICT index_buffer, siz
 		}
 	}
 
-	// Calculate offsets (exclusive scan)
+	// Calculate offsets (exclusive scan), from the top bucket down for descending order
 	for (unsigned int i = 0 ; i < ncols ; ++i) {
 		HVT a = 0;
 		for (unsigned int j = 0 ; j < hist_len ; ++j) {
-			HVT b = histogram[(hist_len*cols[i]) + j];
-			histogram[(hist_len*cols[i]) + j] = a;
+			unsigned int bucket = descending ? hist_len - 1 - j : j;
+			HVT b = histogram[(hist_len*cols[i]) + bucket];
+			histogram[(hist_len*cols[i]) + bucket] = a;
 			a += b;
 		}
 	}
 
 	auto index_buffer_src = index_buffer;
 	auto index_buffer_dst = index_buffer + n;
+	auto src_at = [src, &index_buffer_src](size_t j) -> const T* { return src + index_buffer_src[j]; };
 	// Sort
 	for (unsigned int i = 0 ; i < ncols ; ++i) {
 		for (size_t j = 0 ; j < n ; ++j) {
-			auto k = src[j];
+			pf(j, n, src_at);
+			auto k = src[index_buffer_src[j]];
 			size_t dst = histogram[(hist_len*cols[i]) + ((kf(k) >> shift_table[cols[i]]) & 0xFF)]++;
 			// PERF: This incurs an extra memory read compared to the non-ranked version. Getting around
 			// this would require us to rewrite the input such that the key and the index share a cache-line.
@@ -94,19 +103,19 @@ IdxType* rs_sort_rank(const T* RESTRICT src, IdxType* RESTRICT index_buffer, siz
 // This version is for automatically selecting the smallest
 // possible counter data-type for the histograms.
 // Histograms stored on stack (2KiB-16KiB).
-template<typename T, typename IdxType, typename KeyFunc = decltype(basic_kdfs::kdf<T>), int passes = sizeof(typename std::result_of_t<KeyFunc&&(T)>)>
-IdxType* radix_sort_rank(const T* RESTRICT src, IdxType* RESTRICT index_buffer, size_t n, KeyFunc && kf = basic_kdfs::kdf) {
+template<typename T, typename IdxType, typename KeyFunc = decltype(basic_kdfs::kdf<T>), int passes = sizeof(typename std::result_of_t<KeyFunc&&(T)>), typename Prefetch = rs_prefetch_none>
+IdxType* radix_sort_rank(const T* RESTRICT src, IdxType* RESTRICT index_buffer, size_t n, KeyFunc && kf = basic_kdfs::kdf, const Prefetch& pf = Prefetch()) {
 	if (n < 256) {
 		std::array<uint8_t,256*passes> histogram{0};
-		return rs_sort_rank(src, index_buffer, n, histogram, kf);
+		return rs_sort_rank(src, index_buffer, n, histogram, kf, pf);
 	} else if (n < (1ULL << 16ULL)) {
 		std::array<uint16_t,256*passes> histogram{0};
-		return rs_sort_rank(src, index_buffer, n, histogram, kf);
+		return rs_sort_rank(src, index_buffer, n, histogram, kf, pf);
 	} else if (n < (1ULL << 32ULL)) {
 		std::array<uint32_t,256*passes> histogram{0};
-		return rs_sort_rank(src, index_buffer, n, histogram, kf);
+		return rs_sort_rank(src, index_buffer, n, histogram, kf, pf);
 	} else {
 		std::array<uint64_t,256*passes> histogram{0};
-		return rs_sort_rank(src, index_buffer, n, histogram, kf);
+		return rs_sort_rank(src, index_buffer, n, histogram, kf, pf);
 	}
 }
@@ -0,0 +1,235 @@
+/*
+	Segmented sort: sorting many independent, typically small, segments of an array in one call.
+
+	The segments are described by an offsets array of nseg + 1 entries, segment i being
+	arr[offsets[i]] .. arr[offsets[i+1] - 1]. Each segment is sorted, in place.
+
+	Consecutive segments are grouped into cache-sized batches of at most rs_segment_batch_n
+	entries. Each batch is radix sorted as if the batch-local segment number was stitched in
+	above the key: the sorting passes run over the key of the whole batch, and one final
+	pass orders the records by segment number. The histograms are built, cleared and scanned
+	once per batch rather than once per segment, and the last pass needs no histogram, as
+	the segment offsets are its prefix sum.
+
+	That extra pass costs more than the per-segment overhead it saves once segments get
+	longer, so segments of at least rs_segment_max_n entries are sorted on their own.
+
+	See https://github.com/eloj/radix-sorting#segmented
+*/
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "radix_sort.hpp"
+
+// Batch-local segment number. A batch holds at most rs_segment_batch_n segments.
+typedef std::conditional_t<rs_segment_batch_n <= (1UL << 16), uint16_t, uint32_t> rs_segment_id;
+
+// A record tagged with its segment number, so that each sorting pass writes one stream per bucket.
+template<typename T>
+struct rs_segment_rec {
+	T value;
+	rs_segment_id seg;
+};
+
+// Scratch space needed per thread: two batches of tagged records, and one output cursor per segment.
+template<typename T>
+constexpr size_t rs_segment_scratch_bytes(void) {
+	return (sizeof(rs_segment_rec<T>) * 2 + sizeof(uint32_t)) * rs_segment_batch_n;
+}
+
+// Sorts the segments in [first_seg, last_seg), which hold at most rs_segment_batch_n entries
+// between them, using the caller's scratch space.
+//
+// The batch is sorted on the key, as one array, using one set of histograms. Each record
+// carries its segment number through the passes, and a final pass scatters the records
+// back to their segments, in order, using the segment offsets as the prefix sum.
+// The first pass reads the records from arr, so they're only copied once.
+template<typename T, typename KeyFunc>
+void rs_sort_segment_batch(T* RESTRICT arr, const size_t* offsets, size_t first_seg, size_t last_seg, KeyFunc && kf, void* scratch) {
+	typedef typename std::result_of_t<KeyFunc&&(T)> KeyType;
+	constexpr uint8_t byte_mask = rs_byte_mask_v<KeyFunc, KeyType>;
+	constexpr size_t wc = rs_popcount(byte_mask);
+	constexpr std::array<uint8_t, 8> shift_table = rs_mask_shifts(byte_mask);
+	constexpr unsigned int hist_len = 256;
+	constexpr bool descending = rs_descending_v<KeyFunc>;
+
+	size_t base = offsets[first_seg];
+	size_t n = offsets[last_seg] - base;
+	size_t nseg = last_seg - first_seg;
+	if (n < 2)
+		return;
+	// Nothing to do if every segment has at most one entry.
+	size_t longest = 0;
+	for (size_t s = first_seg ; s < last_seg ; ++s) {
+		longest = std::max(longest, offsets[s + 1] - offsets[s]);
+	}
+	if (longest < 2)
+		return;
+
+	typedef rs_segment_rec<T> R;
+	T *in = arr + base;
+	R *src = static_cast<R*>(scratch);
+	R *aux = src + rs_segment_batch_n;
+	uint32_t *cursor = reinterpret_cast<uint32_t*>(aux + rs_segment_batch_n);
+
+	// Histograms
+	std::array<uint32_t, hist_len*wc> histogram{0};
+	for (size_t i = 0 ; i < n ; ++i) {
+		KeyType key = kf(in[i]);
+		rs_unroll<wc>([&](auto j) {
+			++histogram[(hist_len*j) + ((key >> shift_table[j]) & 0xFF)];
+		});
+	}
+
+	// Sample first key to determine if any columns can be skipped
+	unsigned int cols[wc];
+	unsigned int ncols = 0;
+	KeyType key0 = kf(*in);
+	for (unsigned int i = 0 ; i < wc ; ++i) {
+		if (histogram[(hist_len*i) + ((key0 >> shift_table[i]) & 0xFF)] != n) {
+			cols[ncols++] = i;
+		}
+	}
+	if (ncols == 0)
+		return;
+
+	// Calculate offsets (exclusive scan), from the top bucket down for descending order
+	for (unsigned int i = 0 ; i < ncols ; ++i) {
+		uint32_t a = 0;
+		for (unsigned int j = 0 ; j < hist_len ; ++j) {
+			unsigned int bucket = descending ? hist_len - 1 - j : j;
+			uint32_t b = histogram[(hist_len*cols[i]) + bucket];
+			histogram[(hist_len*cols[i]) + bucket] = a;
+			a += b;
+		}
+	}
+
+	// Sort the whole batch on the key, tagging the records in the first pass.
+	for (size_t s = 0 ; s < nseg ; ++s) {
+		for (size_t j = offsets[first_seg + s] - base ; j < offsets[first_seg + s + 1] - base ; ++j) {
+			size_t dst = histogram[(hist_len*cols[0]) + ((kf(in[j]) >> shift_table[cols[0]]) & 0xFF)]++;
+			src[dst] = { in[j], rs_segment_id(s) };
+		}
+	}
+	for (unsigned int i = 1 ; i < ncols ; ++i) {
+		for (size_t j = 0 ; j < n ; ++j) {
+			size_t dst = histogram[(hist_len*cols[i]) + ((kf(src[j].value) >> shift_table[cols[i]]) & 0xFF)]++;
+			aux[dst] = src[j];
+		}
+		std::swap(src, aux);
+	}
+
+	// Stable pass on the segment number.
+	for (size_t s = 0 ; s < nseg ; ++s) {
+		cursor[s] = offsets[first_seg + s] - base;
+	}
+	for (size_t j = 0 ; j < n ; ++j) {
+		in[cursor[src[j].seg]++] = src[j].value;
+	}
+}
+
+// Splits the segments into batches, calling fn(first_seg, last_seg) for each.
+// Segments of at least rs_segment_max_n entries get a batch of their own. A batch holds
+// at most rs_segment_batch_n entries, and as many segments, which may be empty.
+template<typename Fn>
+void rs_segment_batches(const size_t* offsets, size_t nseg, Fn && fn) {
+	size_t first = 0;
+	for (size_t s = 0 ; s < nseg ; ++s) {
+		if (offsets[s + 1] - offsets[s] >= rs_segment_max_n) {
+			if (s > first)
+				fn(first, s);
+			fn(s, s + 1);
+			first = s + 1;
+		} else if (offsets[s + 1] - offsets[first] > rs_segment_batch_n || s - first == rs_segment_batch_n) {
+			fn(first, s);
+			first = s;
+		}
+	}
+	if (first < nseg)
+		fn(first, nseg);
+}
+
+// Sorts a batch of short segments, or a single long segment on its own.
+// Returns false if an allocation failed.
+template<typename T, typename KeyFunc, typename Alloc>
+bool rs_sort_segment_range(T* arr, const size_t* offsets, size_t first_seg, size_t last_seg, KeyFunc && kf, void* scratch, const Alloc& alloc) {
+	T *src = arr + offsets[first_seg];
+	size_t n = offsets[last_seg] - offsets[first_seg];
+	if (last_seg - first_seg == 1 && n >= rs_segment_max_n) {
+		if (n > rs_segment_batch_n)
+			return radix_sort_alloc(src, n, kf, alloc);
+		T *res = radix_sort(src, static_cast<T*>(scratch), n, kf, alloc);
+		if (res != src)
+			std::memcpy(src, res, sizeof(T) * n);
+		return true;
+	}
+	rs_sort_segment_batch(arr, offsets, first_seg, last_seg, kf, scratch);
+	return true;
+}
+
+// Sort each of the nseg segments of arr given by offsets, in place.
+// Returns false if the temporary buffers could not be allocated, in which case
+// some segments may be left unsorted.
+template<typename T, typename KeyFunc = decltype(basic_kdfs::kdf<T>), typename Alloc = rs_alloc_malloc>
+bool radix_sort_segmented(T* arr, const size_t* offsets, size_t nseg, KeyFunc && kf = basic_kdfs::kdf, const Alloc& alloc = Alloc()) {
+	static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+	constexpr size_t bytes = rs_segment_scratch_bytes<T>();
+
+	void *scratch = alloc.allocate(bytes);
+	if (!scratch)
+		return false;
+
+	bool ok = true;
+	rs_segment_batches(offsets, nseg, [&](size_t first, size_t last) {
+		ok = rs_sort_segment_range(arr, offsets, first, last, kf, scratch, alloc) && ok;
+	});
+
+	alloc.deallocate(scratch, bytes);
+	return ok;
+}
+
+// Multi-threaded version. The batches are handed out to the threads in order, as
+// they become free. A thread count of zero means use the tuned default.
+template<typename T, typename KeyFunc = decltype(basic_kdfs::kdf<T>), typename Alloc = rs_alloc_malloc>
+bool radix_sort_segmented_parallel(T* arr, const size_t* offsets, size_t nseg, KeyFunc && kf = basic_kdfs::kdf, unsigned int threads = 0, const Alloc& alloc = Alloc()) {
+	static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+	constexpr size_t bytes = rs_segment_scratch_bytes<T>();
+
+	threads = rs_num_threads(threads, nseg ? offsets[nseg] - offsets[0] : 0);
+	if (threads < 2)
+		return radix_sort_segmented(arr, offsets, nseg, kf, alloc);
+
+	std::vector<std::pair<size_t, size_t>> batches;
+	rs_segment_batches(offsets, nseg, [&batches](size_t first, size_t last) {
+		batches.emplace_back(first, last);
+	});
+
+	std::atomic<size_t> next { 0 };
+	std::atomic<bool> ok { true };
+	std::vector<std::thread> workers;
+	for (unsigned int t = 0 ; t < threads ; ++t) {
+		workers.emplace_back([&]() {
+			void *scratch = alloc.allocate(bytes);
+			if (!scratch) {
+				ok = false;
+				return;
+			}
+			for (size_t b = next++ ; b < batches.size() ; b = next++) {
+				if (!rs_sort_segment_range(arr, offsets, batches[b].first, batches[b].second, kf, scratch, alloc))
+					ok = false;
+			}
+			alloc.deallocate(scratch, bytes);
+		});
+	}
+	for (auto& w : workers) {
+		w.join();
+	}
+
+	return ok;
+}
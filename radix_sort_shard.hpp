@@ -0,0 +1,118 @@
+/*
+	Sharded sorting, across worker processes on one Linux machine.
+
+	A single process may be capped in how much memory and how many cores it can use, e.g
+	by its container's limits, while the machine has more to spare. So the coordinator, the
+	calling process, does one MSD pass, on the most significant key byte that varies, into a
+	shared memory segment created with memfd_create. That splits the keys into ranges, which
+	are dealt out as contiguous runs of buckets, of about n / shards entries each, to worker
+	processes forked off the coordinator. Each worker maps the segment, sorts its shard in it
+	with radix_sort, using memory of its own for the aux buffer, and exits. As the shards are
+	in key order, the sorted output is their concatenation, which is copied back.
+
+	The split is on bucket boundaries, so with skewed keys a shard may get much more than
+	its share; one worker gets all of any one bucket.
+
+	See https://github.com/eloj/radix-sorting#sharding
+*/
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cinttypes>
+#include <vector>
+
+#include <sys/mman.h> // for memfd_create, mmap
+#include <sys/wait.h> // for waitpid
+#include <unistd.h>   // for fork, ftruncate
+
+#include "radix_sort.hpp"
+
+// The shard boundaries: shard s is [bounds[s], bounds[s+1]). Each boundary is the first bucket
+// offset at or past an even split, so shards may be empty.
+inline std::vector<size_t> rs_shard_bounds(const size_t *offsets, size_t n, unsigned int shards) {
+	std::vector<size_t> bounds(shards + 1, n);
+	bounds[0] = 0;
+	unsigned int j = 0;
+	for (unsigned int s = 1 ; s < shards ; ++s) {
+		size_t even = n * s / shards;
+		while (offsets[j] < even) {
+			++j;
+		}
+		bounds[s] = offsets[j];
+	}
+	return bounds;
+}
+
+// Sorts arr with radix_sort, split into shards sorted by worker processes, see above.
+// A shard count of zero means the tuned default number of threads, see rs_num_threads.
+// T must be trivially copyable, and kf must work in a forked child, which gets a copy of the
+// coordinator's memory. Only the calling thread is forked, so don't fork while other threads
+// hold locks the KDF or allocator needs.
+//
+// Returns true if arr was sorted. On failure to create the segment, fork a worker, or a
+// worker's failure to sort, returns false, leaving arr as it was.
+template<typename T, typename KeyFunc = basic_kdfs::kdf_object, typename Alloc = rs_alloc_malloc>
+bool radix_sort_sharded(T* arr, size_t n, KeyFunc && kf = KeyFunc(), unsigned int shards = 0, const Alloc& alloc = Alloc()) {
+	static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+
+	shards = rs_num_threads(shards, n);
+	if (n == 0)
+		return true;
+
+	size_t bytes = sizeof(T) * n;
+	int fd = memfd_create("radix_sort_sharded", MFD_CLOEXEC);
+	if (fd < 0)
+		return false;
+	void *mem = ftruncate(fd, bytes) == 0 ? mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (mem == MAP_FAILED)
+		return false;
+	T *shm = static_cast<T*>(mem);
+
+	std::array<size_t, 257> offsets;
+	if (rs_msd_partition(arr, shm, n, kf, offsets.data()) == 0) {
+		munmap(mem, bytes);
+		return true;
+	}
+
+	std::vector<size_t> bounds = rs_shard_bounds(offsets.data(), n, shards);
+	std::vector<pid_t> workers;
+	bool ok = true;
+	for (unsigned int s = 0 ; s < shards && ok ; ++s) {
+		size_t len = bounds[s + 1] - bounds[s];
+		if (len < 2)
+			continue;
+		pid_t pid = fork();
+		if (pid == 0) {
+			T *shard = shm + bounds[s];
+			T *aux = static_cast<T*>(alloc.allocate(sizeof(T) * len));
+			T *res = aux ? radix_sort(shard, aux, len, kf, alloc) : nullptr;
+			if (res && res == aux)
+				std::copy(aux, aux + len, shard);
+			_exit(res ? 0 : 1);
+		}
+		if (pid < 0)
+			ok = false;
+		else
+			workers.push_back(pid);
+	}
+
+	// Wait for all the workers that did start, even on failure, so the segment outlives them.
+	for (pid_t pid : workers) {
+		int status;
+		while (waitpid(pid, &status, 0) < 0) {
+			if (errno != EINTR) {
+				status = -1;
+				break;
+			}
+		}
+		ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	}
+
+	if (ok)
+		std::copy(shm, shm + n, arr);
+	munmap(mem, bytes);
+	return ok;
+}
@@ -0,0 +1,157 @@
+/*
+	Statistics and tracing hooks.
+
+	The sort functions take an optional pointer to a hook object with the members:
+
+		void phase_begin(rs_phase phase, unsigned int col);
+		void phase_end(rs_phase phase, unsigned int col);
+		void done(const rs_sort_info& info);
+
+	The column argument is only meaningful for the scatter phase. done() is called
+	once, on every return path that got past the trivial size checks.
+
+	No hook is passed by default, in which case all of this compiles to nothing.
+
+	See https://github.com/eloj/radix-sorting#cpp-implementation
+*/
+#pragma once
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+
+enum class rs_phase {
+	histogram, // Building histograms, and pre-sorted detection.
+	scan,      // Column selection and prefix sums.
+	keys,      // Indirect and cached-key sorts: deriving the (key, index) or (key, entry)-pairs.
+	scatter,   // One sorting pass over a column.
+	gather,    // Indirect and cached-key sorts: moving the records into place.
+	sample,    // radix_sort_adaptive: sampling the keys, and picking the algorithm.
+	num_phases
+};
+
+enum class rs_exit {
+	presorted, // The input was already sorted, nothing was moved.
+	sorted,    // All passes ran.
+};
+
+// Algorithm picked by radix_sort_adaptive. Plain radix_sort is lsd, or comparison for
+// inputs of less than rs_small_n entries, which are insertion sorted.
+enum class rs_strategy {
+	lsd,        // LSD radix sort, radix_sort.
+	msd,        // One MSD pass, then LSD radix sort of each bucket.
+	counting,   // Counting sort over the key range.
+	few_keys,   // Counting sort over the distinct keys, in a hash table.
+	bitmap,     // Bitmap sort; distinct integer keys only.
+	comparison, // std::stable_sort, for nearly sorted input.
+};
+
+// Estimates from the sample taken by radix_sort_adaptive.
+struct rs_sample_info {
+	size_t n = 0;         // Sample size, zero if no sample was taken.
+	size_t distinct = 0;  // Distinct keys in the sample.
+	size_t unordered = 0; // Adjacent sample entries out of order.
+	uint64_t min = 0;     // Smallest and largest key in the sample.
+	uint64_t max = 0;
+};
+
+// Summary of one sort.
+struct rs_sort_info {
+	size_t n = 0;
+	unsigned int key_bytes = 0;     // Width of the key, i.e number of columns.
+	unsigned int counter_bytes = 0; // Width of the histogram counters.
+	unsigned int passes = 0;        // Number of scatter passes run.
+	uint32_t skipped = 0;           // Bit i set if column i was skipped.
+	bool indirect = false;          // Sorted via (key, index)-pairs.
+	rs_exit exit = rs_exit::sorted;
+	size_t bytes_moved = 0;         // Bytes written by the scatter and gather passes.
+	rs_strategy strategy = rs_strategy::lsd;
+	rs_sample_info sample;
+};
+
+inline const char* rs_phase_name(rs_phase phase) {
+	switch (phase) {
+		case rs_phase::histogram: return "histogram";
+		case rs_phase::scan: return "scan";
+		case rs_phase::keys: return "keys";
+		case rs_phase::scatter: return "scatter";
+		case rs_phase::gather: return "gather";
+		case rs_phase::sample: return "sample";
+		case rs_phase::num_phases: break;
+	}
+	return "unknown";
+}
+
+inline const char* rs_strategy_name(rs_strategy strategy) {
+	switch (strategy) {
+		case rs_strategy::lsd: return "lsd";
+		case rs_strategy::msd: return "msd";
+		case rs_strategy::counting: return "counting";
+		case rs_strategy::few_keys: return "few_keys";
+		case rs_strategy::bitmap: return "bitmap";
+		case rs_strategy::comparison: return "comparison";
+	}
+	return "unknown";
+}
+
+inline const char* rs_exit_name(rs_exit exit) {
+	switch (exit) {
+		case rs_exit::presorted: return "presorted";
+		case rs_exit::sorted: return "sorted";
+	}
+	return "unknown";
+}
+
+// Hook that does nothing. Useful as a base for hooks only interested in some events.
+struct rs_stats_none {
+	void phase_begin(rs_phase, unsigned int) { }
+	void phase_end(rs_phase, unsigned int) { }
+	void done(const rs_sort_info&) { }
+};
+
+// Hook recording the wall-clock time of each phase, with scatter passes
+// broken down per column, and the summary of the last sort.
+struct rs_stats {
+	typedef std::chrono::steady_clock clock;
+
+	uint64_t phase_ns[size_t(rs_phase::num_phases)] = { 0 };
+	uint64_t scatter_ns[8] = { 0 };
+	rs_sort_info info;
+
+	void phase_begin(rs_phase, unsigned int) {
+		start = clock::now();
+	}
+
+	void phase_end(rs_phase phase, unsigned int col) {
+		uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count();
+		phase_ns[size_t(phase)] += ns;
+		if (phase == rs_phase::scatter && col < 8)
+			scatter_ns[col] += ns;
+	}
+
+	void done(const rs_sort_info& sort_info) {
+		info = sort_info;
+	}
+
+	void print(FILE *f) const {
+		fprintf(f, "n=%zu key_bytes=%u counter_bytes=%u passes=%u skipped=0x%02x indirect=%d exit=%s bytes_moved=%zu strategy=%s\n",
+			info.n, info.key_bytes, info.counter_bytes, info.passes, info.skipped, info.indirect, rs_exit_name(info.exit), info.bytes_moved, rs_strategy_name(info.strategy));
+		if (info.sample.n)
+			fprintf(f, "sample: n=%zu distinct=%zu unordered=%zu min=0x%" PRIx64 " max=0x%" PRIx64 "\n",
+				info.sample.n, info.sample.distinct, info.sample.unordered, info.sample.min, info.sample.max);
+		for (size_t i = 0 ; i < size_t(rs_phase::num_phases) ; ++i) {
+			if (phase_ns[i] == 0)
+				continue;
+			fprintf(f, "%10s: %10.4f ms\n", rs_phase_name(rs_phase(i)), phase_ns[i] / 1.0e6);
+			if (rs_phase(i) != rs_phase::scatter)
+				continue;
+			for (unsigned int col = 0 ; col < 8 ; ++col) {
+				if (scatter_ns[col])
+					fprintf(f, "%8s %u: %10.4f ms\n", "col", col, scatter_ns[col] / 1.0e6);
+			}
+		}
+	}
+
+private:
+	clock::time_point start;
+};
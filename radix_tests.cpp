@@ -11,6 +11,19 @@
 
 #include "radix_sort.hpp"
 #include "radix_sort_rank.hpp"
+#include "radix_sort_permute.hpp"
+#include "radix_sort_segmented.hpp"
+#include "radix_sort_merge.hpp"
+#include "radix_sort_file.hpp"
+#include "radix_sort_lazy.hpp"
+#include "radix_sort_histogram.hpp"
+#include "radix_sort_adaptive.hpp"
+#include "radix_sort_inplace.hpp"
+#include "radix_sort_partition.hpp"
+#include "radix_sort_msd.hpp"
+#include "radix_sort_onesweep.hpp"
+#include "radix_sort_shard.hpp"
+#include "radix_sort_pack.hpp"
 
 struct sortrec {
 	uint8_t key;
@@ -145,6 +158,56 @@ bool test_sortrec_ptr(bool verbose) {
 	return ok;
 }
 
+struct keyrec {
+	uint32_t key;
+	uint32_t pad[15];
+};
+
+bool test_prefetch_ptr(bool verbose) {
+	size_t N = 100000;
+	std::default_random_engine generator;
+	std::uniform_int_distribution<uint32_t> distribution;
+
+	auto recs = new struct keyrec[N];
+	auto src = new const struct keyrec*[N];
+	auto aux = new const struct keyrec*[N];
+	auto ib = new uint32_t[N*2];
+
+	for (size_t i = 0 ; i < N ; ++i) {
+		recs[i].key = distribution(generator);
+		src[i] = &recs[i];
+	}
+	std::shuffle(src, src + N, generator);
+
+	printf("Sorting struct keyrec*[%zu] (prefetch)... ", N);
+
+	auto kdf_keyrec_ptr = [](const struct keyrec* entry) -> uint32_t {
+		return entry->key;
+	};
+	auto cmp_keyrec_ptr = [](const struct keyrec* a, const struct keyrec* b) {
+		return a->key < b->key;
+	};
+
+	auto ranks = radix_sort_rank(src, ib, N, kdf_keyrec_ptr, rs_prefetch { 8 });
+	bool ok = true;
+	for (size_t i = 1 ; i < N ; ++i) {
+		if (src[ranks[i-1]]->key > src[ranks[i]]->key)
+			ok = false;
+	}
+
+	auto res = radix_sort(src, aux, N, kdf_keyrec_ptr, rs_alloc_malloc(), rs_prefetch { 8 });
+	ok = ok && std::is_sorted(res, res + N, cmp_keyrec_ptr);
+
+	printf("%s\n", ok ? "OK" : "FAILED");
+
+	delete[] recs;
+	delete[] src;
+	delete[] aux;
+	delete[] ib;
+
+	return ok;
+}
+
 void print_float(float *arr, size_t n) {
 	uint32_t local;
 	for (size_t i = 0 ; i < n ; ++i) {
@@ -206,15 +269,1081 @@ bool test_int(bool verbose) {
 	return ok;
 }
 
+// Descending order via the reversed prefix sum, against std::stable_sort on the keys.
+template<typename T>
+bool test_descending_type(const char *name, size_t N) {
+	std::default_random_engine generator;
+	std::uniform_int_distribution<int> distribution(-1000, 1000);
+
+	T* src = new T[N*2];
+	T* aux = src + N;
+	T* ref = new T[N];
+	size_t* ib = new size_t[N*2];
+
+	for (size_t i = 0 ; i < N ; ++i) {
+		src[i] = T(distribution(generator)) / (std::is_floating_point_v<T> ? 4 : 1);
+	}
+	src[0] = -0.0;
+	std::copy(src, src + N, ref);
+
+	printf("Sorting %s[%zu] (descending)... ", name, N);
+
+	auto kf = basic_kdfs::descending(basic_kdfs::kdf<T>);
+	auto ranks = radix_sort_rank(src, ib, N, kf);
+	std::stable_sort(ref, ref + N, [](const T& a, const T& b) { return basic_kdfs::kdf<T>(a) > basic_kdfs::kdf<T>(b); });
+
+	bool ok = true;
+	for (size_t i = 0 ; i < N ; ++i) {
+		ok = ok && std::memcmp(&src[ranks[i]], &ref[i], sizeof(T)) == 0;
+	}
+
+	auto res = radix_sort(src, aux, N, kf);
+	ok = ok && std::memcmp(res, ref, N * sizeof(T)) == 0;
+
+	// Already in order, exercises the pre-sorted detection.
+	res = radix_sort(res, res == src ? aux : src, N, kf);
+	ok = ok && std::memcmp(res, ref, N * sizeof(T)) == 0;
+
+	printf("%s\n", ok ? "OK" : "FAILED");
+
+	delete[] ib;
+	delete[] ref;
+	delete[] src;
+
+	return ok;
+}
+
+bool test_descending(bool verbose) {
+	size_t SZ = sizeof(source_arr);
+	size_t N = SZ/sizeof(source_arr[0]);
+
+	printf("Sorting struct sortrec (stable descending)... ");
+
+	struct sortrec *src = new struct sortrec[N];
+	struct sortrec *aux = new struct sortrec[N];
+	std::memcpy(src, source_arr, SZ);
+
+	struct sortrec *res = radix_sort(src, aux, N, basic_kdfs::descending(kdf_sortrec));
+
+	const char *expected[] = { "1st 255", "2nd 255", "1st 45", "2nd 45", "3rd 45", "3", "2", "1" };
+	// The rank sort has no small input cutoff, so this covers the reversed prefix sum.
+	auto ib = new uint8_t[N*2];
+	auto ranks = radix_sort_rank(source_arr, ib, N, basic_kdfs::descending(kdf_sortrec));
+
+	bool ok = true;
+	for (size_t i = 0 ; i < N ; ++i) {
+		ok = ok && strcmp(res[i].name, expected[i]) == 0;
+		ok = ok && strcmp(source_arr[ranks[i]].name, expected[i]) == 0;
+	}
+
+	printf("%s\n", ok ? "OK" : "FAILED");
+
+	if (verbose)
+		print_sortrec(res, N);
+
+	delete[] ib;
+	delete[] src;
+	delete[] aux;
+
+	return ok &
+		test_descending_type<int>("int", 20) &
+		test_descending_type<int>("int", 50000) &
+		test_descending_type<float>("float", 50000) &
+		test_descending_type<double>("double", 50000) &
+		test_descending_type<uint16_t>("uint16_t", 50000);
+}
+
+// Random entries, from 64-bit random values anded with mask. The same for every call.
+template<typename T>
+std::vector<T> test_random_values(size_t N, uint64_t mask = ~0ULL) {
+	std::default_random_engine generator;
+	std::uniform_int_distribution<uint64_t> distribution;
+
+	std::vector<T> vals(N);
+	for (auto& v : vals) {
+		v = T(distribution(generator) & mask);
+	}
+	return vals;
+}
+
+// The reference the sorts are checked against: std::stable_sort of [first, last) on the
+// keys of kf, in the order it asks for.
+template<typename Iter, typename KeyFunc>
+void test_reference_sort(Iter first, Iter last, KeyFunc && kf) {
+	typedef typename std::iterator_traits<Iter>::value_type T;
+	std::stable_sort(first, last, [&kf](const T& a, const T& b) {
+		return rs_descending_v<KeyFunc> ? kf(a) > kf(b) : kf(a) < kf(b);
+	});
+}
+
+// Sorts the segments of arr, given by offsets, and checks them against std::stable_sort.
+template<typename T, typename KeyFunc>
+bool test_segmented_case(const char *name, std::vector<T> arr, const std::vector<size_t>& offsets, KeyFunc && kf, bool parallel) {
+	size_t nseg = offsets.size() - 1;
+	size_t N = offsets.back();
+	std::vector<T> ref(arr);
+
+	printf("Sorting %s[%zu] in %zu segments%s%s... ", name, N, nseg, rs_descending_v<KeyFunc> ? " (descending)" : "", parallel ? " (parallel)" : "");
+
+	bool ok;
+	if (parallel) {
+		ok = radix_sort_segmented_parallel(arr.data(), offsets.data(), nseg, kf, 4);
+	} else {
+		ok = radix_sort_segmented(arr.data(), offsets.data(), nseg, kf);
+	}
+
+	for (size_t s = 0 ; s < nseg ; ++s) {
+		test_reference_sort(ref.begin() + offsets[s], ref.begin() + offsets[s + 1], kf);
+	}
+	ok = ok && arr == ref;
+
+	printf("%s\n", ok ? "OK" : "FAILED");
+
+	return ok;
+}
+
+// Segments of random length, including empty ones and one larger than a batch.
+template<typename T, typename KeyFunc>
+bool test_segmented_type(const char *name, KeyFunc && kf, bool parallel) {
+	std::default_random_engine generator;
+	std::uniform_int_distribution<size_t> seg_len(0, 100);
+
+	std::vector<size_t> offsets = { 0 };
+	while (offsets.back() < 300000) {
+		size_t len = offsets.size() == 100 ? rs_segment_batch_n * 2 : seg_len(generator);
+		offsets.push_back(offsets.back() + len);
+	}
+
+	// Few distinct low bytes, so that like-keys are common.
+	return test_segmented_case(name, test_random_values<T>(offsets.back(), ~0xF0ULL), offsets, kf, parallel);
+}
+
+bool test_segmented(bool verbose) {
+	// More empty segments than a batch has room for, then a few entries.
+	std::vector<size_t> empty_offsets(100001, 0);
+	empty_offsets.push_back(10);
+	std::vector<uint32_t> empty_arr = { 9, 8, 7, 6, 5, 4, 3, 2, 1, 0 };
+	// As many entries as segments, but not one per segment.
+	std::vector<size_t> mixed_offsets = { 0, 0, 2, 2, 3, 3, 3, 6 };
+	std::vector<uint32_t> mixed_arr = { 5, 3, 1, 9, 4, 7 };
+
+	auto kf = basic_kdfs::kdf<uint32_t>;
+	return
+		test_segmented_type<uint32_t>("uint32_t", kf, false) &
+		test_segmented_type<uint32_t>("uint32_t", kf, true) &
+		test_segmented_type<uint32_t>("uint32_t", basic_kdfs::descending(kf), false) &
+		test_segmented_type<uint64_t>("uint64_t", basic_kdfs::kdf<uint64_t>, false) &
+		test_segmented_type<uint64_t>("uint64_t", basic_kdfs::kdf<uint64_t>, true) &
+		test_segmented_case("empty uint32_t", empty_arr, empty_offsets, kf, false) &
+		test_segmented_case("empty uint32_t", empty_arr, empty_offsets, kf, true) &
+		test_segmented_case("uint32_t", std::vector<uint32_t>{ 5, 3 }, { 0, 2, 2 }, kf, false) &
+		test_segmented_case("uint32_t", mixed_arr, mixed_offsets, kf, false);
+}
+
+// Chunks radix sorted on their own, then merged, against sorting all of it.
+// Threads only kick in with rs_parallel_min_n entries per thread.
+template<typename T, typename KeyFunc>
+bool test_merge_type(const char *name, size_t k, size_t max_len, KeyFunc && kf, unsigned int threads, bool with_aux) {
+	std::default_random_engine generator;
+	std::uniform_int_distribution<int> distribution(-1000, 1000);
+	std::uniform_int_distribution<size_t> chunk_len(0, max_len);
+
+	std::vector<std::vector<T>> chunks(k);
+	std::vector<const T*> spans(k);
+	std::vector<size_t> lens(k);
+	std::vector<T> ref;
+	for (size_t i = 0 ; i < k ; ++i) {
+		chunks[i].resize(chunk_len(generator));
+		for (auto& v : chunks[i]) {
+			v = T(distribution(generator)) / (std::is_floating_point_v<T> ? 8 : 1);
+		}
+		std::vector<T> aux(chunks[i].size());
+		T *res = radix_sort(chunks[i].data(), aux.data(), chunks[i].size(), kf);
+		if (res != chunks[i].data())
+			chunks[i] = aux;
+		spans[i] = chunks[i].data();
+		lens[i] = chunks[i].size();
+		ref.insert(ref.end(), chunks[i].begin(), chunks[i].end());
+	}
+	size_t N = ref.size();
+
+	printf("Merging %zu %s chunks[%zu]%s, %u threads%s... ", k, name, N, rs_descending_v<KeyFunc> ? " (descending)" : "", threads, with_aux ? ", aux" : "");
+
+	std::vector<T> aux(N);
+	T *ref_res = radix_sort(ref.data(), aux.data(), N, kf);
+	std::vector<T> expected(ref_res, ref_res + N);
+
+	std::vector<T> dst(N);
+	T *res;
+	if (k == 2) {
+		res = radix_merge(spans[0], lens[0], spans[1], lens[1], dst.data(), kf, threads);
+	} else {
+		res = radix_merge_k(spans.data(), lens.data(), k, dst.data(), with_aux ? aux.data() : nullptr, kf, threads);
+	}
+
+	bool ok = res == dst.data() && std::memcmp(dst.data(), expected.data(), N * sizeof(T)) == 0;
+
+	printf("%s\n", ok ? "OK" : "FAILED");
+
+	return ok;
+}
+
+bool test_merge(bool verbose) {
+	return
+		test_merge_type<float>("float", 2, 5000, basic_kdfs::kdf<float>, 1, false) &
+		test_merge_type<float>("float", 2, 400000, basic_kdfs::kdf<float>, 4, false) &
+		test_merge_type<int>("int", 7, 100000, basic_kdfs::kdf<int>, 3, true) &
+		test_merge_type<int>("int", 8, 100000, basic_kdfs::descending(basic_kdfs::kdf<int>), 4, false) &
+		test_merge_type<double>("double", 13, 1000, basic_kdfs::kdf<double>, 1, true);
+}
+
+// Sorting from a file, read in small blocks, with a trailing partial entry.
+bool test_sort_fd(bool verbose) {
+	size_t N = 100000;
+	std::default_random_engine generator;
+	std::uniform_int_distribution<uint32_t> distribution;
+
+	std::vector<uint32_t> keys(N);
+	for (auto& k : keys) {
+		k = distribution(generator);
+	}
+
+	printf("Sorting uint32_t[%zu] from file... ", N);
+
+	FILE *f = tmpfile();
+	bool ok = f && fwrite(keys.data(), sizeof(uint32_t), N, f) == N && fwrite("xy", 1, 2, f) == 2 && fflush(f) == 0;
+
+	std::vector<uint32_t> buf(N + 10);
+	std::vector<uint32_t> aux(N + 10);
+	std::sort(keys.begin(), keys.end());
+	for (int round = 0 ; ok && round < 2 ; ++round) {
+		// The second round sorts the sorted keys, for the pre-sorted detection across blocks.
+		size_t n = buf.size();
+		ok = lseek(fileno(f), 0, SEEK_SET) == 0;
+		uint32_t *res = radix_sort_fd(fileno(f), buf.data(), aux.data(), &n, basic_kdfs::kdf<uint32_t>, 4096);
+		ok = ok && res && n == N && std::equal(keys.begin(), keys.end(), res);
+		if (round == 0) {
+			ok = ok && lseek(fileno(f), 0, SEEK_SET) == 0 && fwrite(keys.data(), sizeof(uint32_t), N, f) == N && fflush(f) == 0;
+		} else {
+			ok = ok && res == buf.data();
+		}
+	}
+
+	// Capacity less than the file.
+	size_t n = 1000;
+	ok = ok && lseek(fileno(f), 0, SEEK_SET) == 0;
+	uint32_t *res = radix_sort_fd(fileno(f), buf.data(), aux.data(), &n, basic_kdfs::kdf<uint32_t>, 1000);
+	ok = ok && res && n == 1000 && std::equal(keys.begin(), keys.begin() + 1000, res);
+
+	if (f)
+		fclose(f);
+
+	printf("%s\n", ok ? "OK" : "FAILED");
+
+	return ok;
+}
+
+// Sorting with histograms built by the caller, in chunks, with the sortedness and min/max.
+template<typename T, typename KeyFunc>
+bool test_histogram_type(const char *name, size_t N, KeyFunc && kf) {
+	std::vector<T> src = test_random_values<T>(N);
+	std::vector<T> aux(N);
+	std::vector<T> ref(src);
+	test_reference_sort(ref.begin(), ref.end(), kf);
+
+	printf("Sorting %s[%zu] with precomputed histograms%s... ", name, N, rs_descending_v<KeyFunc> ? " (descending)" : "");
+
+	radix_histogram<T, std::decay_t<KeyFunc>> hist(kf);
+	for (size_t i = 0 ; i < N ; i += 1000) {
+		hist.add(src.data() + i, std::min<size_t>(1000, N - i));
+	}
+	bool ok = hist.size() == N && (N < 2 || !hist.sorted());
+	if (N > 0) {
+		auto [mi, ma] = std::minmax_element(src.begin(), src.end(), [&kf](const T& a, const T& b) { return kf(a) < kf(b); });
+		ok = ok && hist.min_key() == kf(*mi) && hist.max_key() == kf(*ma);
+	}
+	ok = ok && radix_sort_with_histogram(src.data(), aux.data(), N + 1, hist) == nullptr;
+
+	rs_stats stats;
+	T *res = radix_sort_with_histogram(src.data(), aux.data(), N, hist, rs_alloc_malloc(), rs_prefetch_none(), &stats);
+	ok = ok && (res || N == 0) && std::equal(ref.begin(), ref.end(), res);
+
+	// Re-adding the sorted output should be detected as sorted.
+	if (res) {
+		hist.clear();
+		hist.add(res, N);
+		ok = ok && hist.sorted() && radix_sort_with_histogram(res, res == src.data() ? aux.data() : src.data(), N, hist) == res;
+	}
+
+	printf("%s\n", ok ? "OK" : "FAILED");
+
+	return ok;
+}
+
+bool test_histogram(bool verbose) {
+	return
+		test_histogram_type<uint32_t>("uint32_t", 100000, basic_kdfs::kdf_object()) &
+		test_histogram_type<uint16_t>("uint16_t", 1000, basic_kdfs::kdf<uint16_t>) &
+		test_histogram_type<float>("float", 20, basic_kdfs::kdf<float>) &
+		test_histogram_type<int64_t>("int64_t", 70000, basic_kdfs::descending(basic_kdfs::kdf<int64_t>)) &
+		test_histogram_type<uint32_t>("uint32_t", 0, basic_kdfs::kdf<uint32_t>);
+}
+
+template<typename T, typename KeyFunc>
+bool test_lazy_type(const char *name, size_t N, T mask, KeyFunc && kf) {
+	std::vector<T> src = test_random_values<T>(N, mask);
+	std::vector<T> buf(N);
+	std::vector<T> aux(N);
+	std::vector<T> ref(src);
+	test_reference_sort(ref.begin(), ref.end(), kf);
+
+	printf("Lazy sorting %s[%zu]%s... ", name, N, rs_descending_v<KeyFunc> ? " (descending)" : "");
+
+	radix_sorted_range range(src.data(), buf.data(), aux.data(), N, kf);
+
+	// Taking the first few entries should only sort the first bucket.
+	bool ok = true;
+	size_t i = 0;
+	for (auto it = range.begin() ; it != range.end() && i < 10 ; ++it, ++i) {
+		ok = ok && *it == ref[i];
+	}
+	ok = ok && range.buckets_sorted() <= 1;
+
+	i = 0;
+	for (const T& v : range) {
+		ok = ok && i < N && v == ref[i++];
+	}
+	ok = ok && i == N;
+
+	printf("%s\n", ok ? "OK" : "FAILED");
+
+	return ok;
+}
+
+bool test_lazy(bool verbose) {
+	return
+		test_lazy_type<uint32_t>("uint32_t", 100000, ~0U, basic_kdfs::kdf_object()) &
+		test_lazy_type<uint32_t>("uint32_t", 100000, 0xFFFFU, basic_kdfs::kdf<uint32_t>) &
+		test_lazy_type<uint32_t>("uint32_t", 1000, 0, basic_kdfs::kdf<uint32_t>) &
+		test_lazy_type<uint64_t>("uint64_t", 100000, ~0UL, basic_kdfs::descending(basic_kdfs::kdf<uint64_t>)) &
+		test_lazy_type<uint32_t>("uint32_t", 0, ~0U, basic_kdfs::kdf<uint32_t>);
+}
+
+// Sorts src with radix_sort_adaptive, checking the result against std::stable_sort,
+// and that the expected algorithm was picked.
+template<typename T, typename KeyFunc>
+bool test_adaptive_case(const char *name, std::vector<T> src, KeyFunc && kf, rs_strategy expected, bool verbose) {
+	size_t N = src.size();
+	std::vector<T> aux(N);
+	std::vector<T> ref(src);
+	test_reference_sort(ref.begin(), ref.end(), kf);
+
+	printf("Adaptive sorting %s[%zu]... ", name, N);
+
+	rs_stats stats;
+	T *res = radix_sort_adaptive(src.data(), aux.data(), N, kf, rs_alloc_malloc(), rs_prefetch_none(), &stats);
+	bool ok = std::equal(ref.begin(), ref.end(), res) && stats.info.strategy == expected;
+
+	printf("%s (%s)\n", ok ? "OK" : "FAILED", rs_strategy_name(stats.info.strategy));
+	if (!ok || verbose)
+		stats.print(stdout);
+
+	return ok;
+}
+
+bool test_adaptive(bool verbose) {
+	size_t N = 1 << 17;
+	std::default_random_engine generator;
+	std::uniform_int_distribution<uint32_t> distribution;
+
+	std::vector<uint32_t> uniform(N);
+	for (auto& v : uniform) {
+		v = distribution(generator);
+	}
+
+	std::vector<uint32_t> narrow(N);
+	for (auto& v : narrow) {
+		v = 1000 + distribution(generator) % 5000;
+	}
+	std::vector<int64_t> narrow_signed(N);
+	for (auto& v : narrow_signed) {
+		v = int64_t(distribution(generator) % 20000) - 10000;
+	}
+
+	std::vector<uint32_t> distinct(N);
+	for (size_t i = 0 ; i < N ; ++i) {
+		distinct[i] = 12345 + i * 3;
+	}
+	std::shuffle(distinct.begin(), distinct.end(), generator);
+	// A duplicate the sample won't see, which the bitmap sort must catch.
+	std::vector<uint32_t> almost_distinct(distinct);
+	almost_distinct[1] = almost_distinct[0];
+
+	std::vector<uint32_t> nearly_sorted(distinct);
+	std::sort(nearly_sorted.begin(), nearly_sorted.end());
+	for (size_t i = 0 ; i < N / 100 ; ++i) {
+		std::swap(nearly_sorted[distribution(generator) % N], nearly_sorted[distribution(generator) % N]);
+	}
+
+	// Enum-like keys: a few values, spread over the whole range.
+	std::vector<uint32_t> few_values(20);
+	for (auto& v : few_values) {
+		v = distribution(generator);
+	}
+	std::vector<uint32_t> few(N);
+	for (auto& v : few) {
+		v = few_values[distribution(generator) % few_values.size()];
+	}
+	typedef std::pair<int64_t, uint32_t> rec;
+	std::vector<rec> few_recs(N);
+	for (size_t i = 0 ; i < N ; ++i) {
+		few_recs[i] = { int64_t(few[i]) - INT32_MAX, i };
+	}
+	auto rec_kf = basic_kdfs::descending([](const rec& r) { return basic_kdfs::kdf<int64_t>(r.first); });
+	// Distinct keys the sample won't see, so the hash table overflows.
+	std::vector<uint32_t> almost_few(few);
+	for (size_t i = 1 ; i < N ; i += 2) {
+		almost_few[i] = distribution(generator);
+	}
+
+	// A narrow sample, but keys the sample won't see span the full 64-bit range.
+	std::vector<uint64_t> full_range(N);
+	for (auto& v : full_range) {
+		v = distribution(generator) % 1000;
+	}
+	full_range[1] = 0;
+	full_range[2] = UINT64_MAX;
+
+	std::vector<uint64_t> wide(rs_msd_min_bytes / sizeof(uint64_t));
+	for (auto& v : wide) {
+		v = (uint64_t(distribution(generator)) << 32) | distribution(generator);
+	}
+
+	return
+		test_adaptive_case("uint32_t", std::vector<uint32_t>(uniform.begin(), uniform.begin() + 1000), basic_kdfs::kdf_object(), rs_strategy::lsd, verbose) &
+		test_adaptive_case("uint32_t", uniform, basic_kdfs::kdf_object(), rs_strategy::lsd, verbose) &
+		test_adaptive_case("uint32_t", narrow, basic_kdfs::kdf_object(), rs_strategy::counting, verbose) &
+		test_adaptive_case("int64_t", narrow_signed, basic_kdfs::descending(basic_kdfs::kdf<int64_t>), rs_strategy::counting, verbose) &
+		test_adaptive_case("uint32_t", distinct, basic_kdfs::kdf_object(), rs_strategy::bitmap, verbose) &
+		test_adaptive_case("uint32_t", distinct, basic_kdfs::kdf<uint32_t>, rs_strategy::lsd, verbose) &
+		test_adaptive_case("uint32_t", almost_distinct, basic_kdfs::kdf_object(), rs_strategy::lsd, verbose) &
+		test_adaptive_case("uint32_t", nearly_sorted, basic_kdfs::kdf_object(), rs_strategy::comparison, verbose) &
+		test_adaptive_case("uint32_t", few, basic_kdfs::kdf_object(), rs_strategy::few_keys, verbose) &
+		test_adaptive_case("int64_t record", few_recs, rec_kf, rs_strategy::few_keys, verbose) &
+		test_adaptive_case("uint32_t", almost_few, basic_kdfs::kdf_object(), rs_strategy::lsd, verbose) &
+		test_adaptive_case("uint64_t", full_range, basic_kdfs::kdf_object(), rs_strategy::lsd, verbose) &
+		test_adaptive_case("uint64_t", wide, basic_kdfs::kdf_object(), rs_strategy::msd, verbose);
+}
+
+// The in-place sort is not stable, so only the keys are compared to the reference,
+// along with checking that the entries are a permutation of the input.
+template<typename T, typename KeyFunc>
+bool test_inplace_type(const char *name, size_t N, T mask, unsigned int threads, KeyFunc && kf) {
+	std::vector<T> src = test_random_values<T>(N, mask);
+	std::vector<T> ref(src);
+	test_reference_sort(ref.begin(), ref.end(), kf);
+	std::vector<T> values(src);
+	std::sort(values.begin(), values.end());
+
+	printf("In-place sorting %s[%zu] on %u thread(s)%s... ", name, N, threads, rs_descending_v<KeyFunc> ? " (descending)" : "");
+
+	bool ok = radix_sort_inplace(src.data(), N, kf, threads);
+	for (size_t i = 0 ; i < N && ok ; ++i) {
+		ok = kf(src[i]) == kf(ref[i]);
+	}
+	std::sort(src.begin(), src.end());
+	ok = ok && src == values;
+
+	printf("%s\n", ok ? "OK" : "FAILED");
+
+	return ok;
+}
+
+bool test_inplace(bool verbose) {
+	return
+		test_inplace_type<uint32_t>("uint32_t", 0, ~0U, 1, basic_kdfs::kdf_object()) &
+		test_inplace_type<uint32_t>("uint32_t", 1000, ~0U, 1, basic_kdfs::kdf_object()) &
+		test_inplace_type<uint32_t>("uint32_t", 1000000, ~0U, 1, basic_kdfs::kdf_object()) &
+		test_inplace_type<uint32_t>("uint32_t", 1000000, ~0U, 4, basic_kdfs::kdf_object()) &
+		test_inplace_type<uint32_t>("uint32_t", 1000000, 0x00FF00FFU, 4, basic_kdfs::kdf<uint32_t>) &
+		test_inplace_type<uint16_t>("uint16_t", 300000, 0xFFFF, 3, basic_kdfs::kdf_object()) &
+		test_inplace_type<int64_t>("int64_t", 1000000, ~0L, 4, basic_kdfs::descending(basic_kdfs::kdf<int64_t>)) &
+		test_inplace_type<uint64_t>("uint64_t", 500000, 0xFFFF, 2, basic_kdfs::with_byte_mask<0b11>(basic_kdfs::kdf<uint64_t>));
+}
+
+// Checks radix_partition against a stable sort on the partition number.
+template<typename T, typename KeyFunc>
+bool test_partition_type(const char *name, size_t N, unsigned int bits, unsigned int shift, unsigned int threads, KeyFunc && kf, size_t skew = sizeof(T)) {
+	std::default_random_engine generator;
+	std::uniform_int_distribution<uint64_t> distribution;
+
+	std::vector<T> src(N);
+	for (auto& v : src) {
+		if constexpr (std::is_arithmetic_v<T>) {
+			v = T(distribution(generator));
+		} else {
+			for (auto& w : v) {
+				w = distribution(generator);
+			}
+		}
+	}
+	size_t fan = size_t(1) << bits;
+	auto part_of = [&](const T& v) {
+		size_t p = (kf(v) >> shift) & (fan - 1);
+		return rs_descending_v<KeyFunc> ? fan - 1 - p : p;
+	};
+	std::vector<T> ref(src);
+	test_reference_sort(ref.begin(), ref.end(), part_of);
+	// Offset by skew bytes, one entry by default, so that the output is not aligned.
+	std::vector<T> dst(N + 1);
+	T *out = reinterpret_cast<T*>(reinterpret_cast<uint8_t*>(dst.data()) + skew);
+
+	printf("Partitioning %s[%zu] on bits %u..%u, %u thread(s)%s... ", name, N, shift, shift + bits - 1, threads, rs_descending_v<KeyFunc> ? " (descending)" : "");
+
+	std::vector<size_t> offsets = radix_partition(src.data(), out, N, bits, shift, kf, threads);
+	bool ok = offsets.size() == fan + 1 && offsets[0] == 0 && offsets[fan] == N;
+	ok = ok && std::equal(ref.begin(), ref.end(), out);
+	for (size_t p = 0 ; p < fan && ok ; ++p) {
+		for (size_t i = offsets[p] ; i < offsets[p + 1] && ok ; ++i) {
+			ok = part_of(out[i]) == p;
+		}
+	}
+
+	printf("%s\n", ok ? "OK" : "FAILED");
+
+	return ok;
+}
+
+bool test_partition(bool verbose) {
+	uint32_t src[4] = { 4, 3, 2, 1 };
+	uint32_t dst[4];
+	printf("Partitioning with out of range bits... ");
+	bool ok = radix_partition(src, dst, 4, 3, 0).empty() && radix_partition(src, dst, 4, 15, 0).empty() && radix_partition(src, dst, 4, 8, 28).empty();
+	printf("%s\n", ok ? "OK" : "FAILED");
+
+	return
+		ok &
+		test_partition_type<uint32_t>("uint32_t", 0, 4, 0, 1, basic_kdfs::kdf_object()) &
+		test_partition_type<uint32_t>("uint32_t", 1000, 4, 0, 1, basic_kdfs::kdf_object()) &
+		test_partition_type<uint32_t>("uint32_t", 300000, 8, 24, 1, basic_kdfs::kdf_object()) &
+		test_partition_type<uint32_t>("uint32_t", 300000, 14, 5, 4, basic_kdfs::kdf_object()) &
+		test_partition_type<uint16_t>("uint16_t", 300000, 10, 6, 2, basic_kdfs::kdf_object()) &
+		test_partition_type<uint64_t>("uint64_t", 300000, 12, 50, 3, basic_kdfs::descending(basic_kdfs::kdf<uint64_t>)) &
+		test_partition_type<std::array<uint32_t, 10>>("uint32_t[10]", 100000, 6, 0, 2, [](const std::array<uint32_t, 10>& r) { return r[3]; }) &
+		// Aligned to less than its size, and written at an offset that isn't a multiple of it.
+		test_partition_type<std::array<uint32_t, 2>>("uint32_t[2]", rs_partition_wc_min_n * 2, 8, 0, 1, [](const std::array<uint32_t, 2>& r) { return r[0]; }, 4);
+}
+
+// Sorting pointers with a cached KDF, which must give the same result as the plain KDF.
+template<typename KeyFunc>
+bool test_cached_keys_case(const char *name, const std::vector<const uint64_t*>& src, KeyFunc && kf) {
+	size_t N = src.size();
+	std::vector<const uint64_t*> a(src), b(src), aux_a(N), aux_b(N);
+
+	printf("Sorting pointers with cached keys, %s[%zu]... ", name, N);
+
+	auto ref = radix_sort(a.data(), aux_a.data(), N, kf);
+	rs_stats stats;
+	auto res = radix_sort(b.data(), aux_b.data(), N, basic_kdfs::cached(kf), rs_alloc_malloc(), rs_prefetch_none(), &stats);
+	bool ok = std::equal(ref, ref + N, res);
+	// The keys are derived in the keys phase, instead of the histogram phase.
+	ok = ok && (N < rs_small_n || (stats.phase_ns[size_t(rs_phase::keys)] > 0 && stats.phase_ns[size_t(rs_phase::histogram)] == 0));
+
+	printf("%s\n", ok ? "OK" : "FAILED");
+
+	return ok;
+}
+
+bool test_cached_keys(bool verbose) {
+	size_t N = 100000;
+	std::default_random_engine generator;
+	std::uniform_int_distribution<uint64_t> distribution(0, 1000);
+
+	std::vector<uint64_t> values(N);
+	for (auto& v : values) {
+		v = distribution(generator);
+	}
+	std::vector<const uint64_t*> ptrs(N);
+	for (size_t i = 0 ; i < N ; ++i) {
+		ptrs[i] = &values[i];
+	}
+	std::vector<const uint64_t*> sorted(ptrs);
+	std::stable_sort(sorted.begin(), sorted.end(), [](const uint64_t* a, const uint64_t* b) { return *a < *b; });
+
+	auto deref = [](const uint64_t* p) { return *p; };
+
+	return
+		test_cached_keys_case("uint64_t*", ptrs, deref) &
+		test_cached_keys_case("uint64_t*", std::vector<const uint64_t*>(ptrs.begin(), ptrs.begin() + 10), deref) &
+		test_cached_keys_case("sorted uint64_t*", sorted, deref) &
+		test_cached_keys_case("masked uint64_t*", ptrs, basic_kdfs::with_byte_mask<0b11>(deref)) &
+		test_cached_keys_case("descending uint64_t*", ptrs, basic_kdfs::descending(deref));
+}
+
+// An executor that runs the workers one after the other, on the calling thread, as a
+// stand-in for a thread pool that is busy.
+struct test_executor_serial {
+	unsigned int n;
+
+	unsigned int workers(void) const { return n; }
+
+	template<typename F>
+	void run(F && fn) const {
+		for (unsigned int w = n ; w-- > 0 ; ) {
+			fn(w);
+		}
+	}
+};
+
+// The keys the parallel and sharded sorts are tested on.
+struct test_key_sets {
+	std::vector<uint64_t> uniform;
+	// Half of the keys share their top six bytes, so the first split leaves one huge bucket,
+	// and a quarter are the same key, so one tile or shard gets at least that.
+	std::vector<uint64_t> skewed;
+	std::vector<uint64_t> sorted;
+	// 24-bit keys, for sorting with a byte mask.
+	std::vector<uint64_t> narrow;
+};
+
+test_key_sets test_make_key_sets(size_t N) {
+	std::default_random_engine generator;
+	std::uniform_int_distribution<uint64_t> distribution;
+	test_key_sets keys;
+
+	keys.uniform.resize(N);
+	for (auto& v : keys.uniform) {
+		v = distribution(generator);
+	}
+	keys.skewed.resize(N);
+	for (auto& v : keys.skewed) {
+		uint64_t r = distribution(generator);
+		v = r % 4 == 0 ? 0x1234 : r % 4 == 1 ? 0x1234000000000000UL | (r >> 48) : r;
+	}
+	keys.sorted = keys.uniform;
+	std::sort(keys.sorted.begin(), keys.sorted.end());
+	keys.narrow.resize(N);
+	for (auto& v : keys.narrow) {
+		v = distribution(generator) & 0xFFFFFF;
+	}
+	return keys;
+}
+
+// Sorting (key, sequence number)-pairs, so that stability is checked too.
+// The records must be trivially copyable, for sharding, which std::pair isn't.
+struct test_seq_rec {
+	uint64_t first;
+	uint32_t second;
+
+	bool operator==(const test_seq_rec& other) const {
+		return first == other.first && second == other.second;
+	}
+};
+
+// The KDF of the records for kf. The KDF wrappers are kept, so that the byte mask and order carry over.
+template<typename KeyFunc>
+auto test_seq_kdf(KeyFunc && kf) {
+	auto key_of = [&kf](const test_seq_rec& r) { return kf(r.first); };
+	if constexpr (rs_descending_v<KeyFunc>) {
+		return basic_kdfs::descending(key_of);
+	} else {
+		return basic_kdfs::with_byte_mask<rs_byte_mask_v<KeyFunc, uint64_t>>(key_of);
+	}
+}
+
+// Returns the records of keys, in order, and sets ref to them stably sorted by kf.
+template<typename KeyFunc>
+std::vector<test_seq_rec> test_seq_records(const std::vector<uint64_t>& keys, KeyFunc && kf, std::vector<test_seq_rec>& ref) {
+	size_t N = keys.size();
+	std::vector<test_seq_rec> recs(N);
+	for (size_t i = 0 ; i < N ; ++i) {
+		recs[i] = { keys[i], uint32_t(i) };
+	}
+	ref = recs;
+	test_reference_sort(ref.begin(), ref.end(), test_seq_kdf(kf));
+	return recs;
+}
+
+// sort is called as sort(src, aux, n, kf, ex), and returns a pointer to the sorted entries.
+template<typename KeyFunc, typename Executor, typename Sort>
+bool test_parallel_sort_case(const char *algo, const char *name, const std::vector<uint64_t>& keys, KeyFunc && kf, const Executor& ex, Sort && sort) {
+	size_t N = keys.size();
+	std::vector<test_seq_rec> ref;
+	std::vector<test_seq_rec> src = test_seq_records(keys, kf, ref);
+	std::vector<test_seq_rec> aux(N);
+
+	printf("%s %s[%zu] on %u worker(s)%s... ", algo, name, N, ex.workers(), rs_descending_v<KeyFunc> ? " (descending)" : "");
+
+	test_seq_rec *res = sort(src.data(), aux.data(), N, test_seq_kdf(kf), ex);
+	bool ok = std::equal(ref.begin(), ref.end(), res);
+
+	printf("%s\n", ok ? "OK" : "FAILED");
+
+	return ok;
+}
+
+bool test_msd_parallel(bool verbose) {
+	test_key_sets keys = test_make_key_sets(1000000);
+	std::vector<uint64_t> small(keys.uniform.begin(), keys.uniform.begin() + 1000);
+
+	auto kf = basic_kdfs::kdf<uint64_t>;
+	auto msd = [](auto *src, auto *aux, size_t n, auto && rec_kf, const auto& ex) { return radix_sort_msd_parallel(src, aux, n, rec_kf, ex); };
+	return
+		test_parallel_sort_case("Parallel MSD sorting", "uint64_t", small, kf, rs_executor_threads { 4 }, msd) &
+		test_parallel_sort_case("Parallel MSD sorting", "uint64_t", keys.uniform, kf, rs_executor_threads { 1 }, msd) &
+		test_parallel_sort_case("Parallel MSD sorting", "uint64_t", keys.uniform, kf, rs_executor_threads { 4 }, msd) &
+		test_parallel_sort_case("Parallel MSD sorting", "skewed uint64_t", keys.skewed, kf, rs_executor_threads { 4 }, msd) &
+		test_parallel_sort_case("Parallel MSD sorting", "skewed uint64_t", keys.skewed, kf, test_executor_serial { 3 }, msd) &
+		test_parallel_sort_case("Parallel MSD sorting", "sorted uint64_t", keys.sorted, kf, rs_executor_threads { 4 }, msd) &
+		test_parallel_sort_case("Parallel MSD sorting", "uint64_t", keys.skewed, basic_kdfs::descending(kf), rs_executor_threads { 3 }, msd) &
+		test_parallel_sort_case("Parallel MSD sorting", "24-bit uint64_t", keys.narrow, basic_kdfs::with_byte_mask<0b111>(kf), rs_executor_threads { 2 }, msd);
+}
+
+bool test_onesweep(bool verbose) {
+	test_key_sets keys = test_make_key_sets(1000000);
+	std::vector<uint64_t> small(keys.uniform.begin(), keys.uniform.begin() + 1000);
+	// Not a multiple of the tile size.
+	std::vector<uint64_t> odd(keys.uniform.begin(), keys.uniform.begin() + rs_onesweep_tile_n * 5 + 17);
+
+	auto kf = basic_kdfs::kdf<uint64_t>;
+	auto onesweep = [](auto *src, auto *aux, size_t n, auto && rec_kf, const auto& ex) { return radix_sort_onesweep(src, aux, n, rec_kf, ex); };
+	return
+		test_parallel_sort_case("Onesweep sorting", "uint64_t", small, kf, rs_executor_threads { 4 }, onesweep) &
+		test_parallel_sort_case("Onesweep sorting", "uint64_t", keys.uniform, kf, rs_executor_threads { 1 }, onesweep) &
+		test_parallel_sort_case("Onesweep sorting", "uint64_t", keys.uniform, kf, rs_executor_threads { 4 }, onesweep) &
+		test_parallel_sort_case("Onesweep sorting", "uint64_t", odd, kf, rs_executor_threads { 3 }, onesweep) &
+		test_parallel_sort_case("Onesweep sorting", "skewed uint64_t", keys.skewed, kf, rs_executor_threads { 4 }, onesweep) &
+		test_parallel_sort_case("Onesweep sorting", "skewed uint64_t", keys.skewed, kf, test_executor_serial { 3 }, onesweep) &
+		test_parallel_sort_case("Onesweep sorting", "sorted uint64_t", keys.sorted, kf, rs_executor_threads { 4 }, onesweep) &
+		test_parallel_sort_case("Onesweep sorting", "uint64_t", keys.skewed, basic_kdfs::descending(kf), rs_executor_threads { 3 }, onesweep) &
+		test_parallel_sort_case("Onesweep sorting", "24-bit uint64_t", keys.narrow, basic_kdfs::with_byte_mask<0b111>(kf), rs_executor_threads { 2 }, onesweep);
+}
+
+template<typename KeyFunc>
+bool test_sharded_case(const char *name, const std::vector<uint64_t>& keys, KeyFunc && kf, unsigned int shards) {
+	size_t N = keys.size();
+	std::vector<test_seq_rec> ref;
+	std::vector<test_seq_rec> arr = test_seq_records(keys, kf, ref);
+
+	printf("Sharded sorting %s[%zu] in %u process(es)%s... ", name, N, shards, rs_descending_v<KeyFunc> ? " (descending)" : "");
+
+	bool ok = radix_sort_sharded(arr.data(), N, test_seq_kdf(kf), shards) && arr == ref;
+
+	printf("%s\n", ok ? "OK" : "FAILED");
+
+	return ok;
+}
+
+bool test_sharded(bool verbose) {
+	test_key_sets keys = test_make_key_sets(1000000);
+	std::vector<uint64_t> small(keys.uniform.begin(), keys.uniform.begin() + 1000);
+
+	auto kf = basic_kdfs::kdf<uint64_t>;
+	return
+		test_sharded_case("uint64_t", small, kf, 4) &
+		test_sharded_case("uint64_t", keys.uniform, kf, 1) &
+		test_sharded_case("uint64_t", keys.uniform, kf, 4) &
+		test_sharded_case("skewed uint64_t", keys.skewed, kf, 7) &
+		test_sharded_case("sorted uint64_t", keys.sorted, kf, 4) &
+		test_sharded_case("uint64_t", keys.skewed, basic_kdfs::descending(kf), 3) &
+		test_sharded_case("24-bit uint64_t", keys.narrow, basic_kdfs::with_byte_mask<0b111>(kf), 2);
+}
+
+// Round-trips sorted values through radix_pack_sorted, whole and in two chunks, and checks
+// that unsorted input and truncated output are rejected.
+template<typename T>
+bool test_pack_case(const char *name, std::vector<T> src) {
+	size_t N = src.size();
+	std::sort(src.begin(), src.end());
+
+	printf("Packing sorted %s[%zu]... ", name, N);
+
+	std::vector<uint8_t> packed(rs_pack_bound<T>(N));
+	std::vector<T> dst(N);
+	size_t bytes = radix_pack_sorted(src.data(), N, packed.data());
+	bool ok = bytes <= packed.size() && (bytes > 0 || N == 0);
+	ok = ok && radix_unpack_sorted(packed.data(), bytes, N, dst.data()) == bytes && dst == src;
+
+	if (N > 1) {
+		size_t half = N / 2;
+		size_t b0 = radix_pack_sorted(src.data(), half, packed.data());
+		size_t b1 = radix_pack_sorted(src.data() + half, N - half, packed.data() + b0, src[half - 1]);
+		std::fill(dst.begin(), dst.end(), 0);
+		ok = ok && radix_unpack_sorted(packed.data(), b0, half, dst.data()) == b0;
+		ok = ok && radix_unpack_sorted(packed.data() + b0, b1, N - half, dst.data() + half, src[half - 1]) == b1;
+		ok = ok && dst == src;
+
+		ok = ok && radix_unpack_sorted(packed.data(), b0 - 1, half, dst.data()) == 0;
+		if (src[0] != src[N - 1]) {
+			std::swap(src[0], src[N - 1]);
+			ok = ok && radix_pack_sorted(src.data(), N, packed.data()) == 0;
+		}
+	}
+
+	printf("%s (%zu bytes, %.2f bits/value)\n", ok ? "OK" : "FAILED", bytes, N ? 8.0 * bytes / N : 0.0);
+
+	return ok;
+}
+
+bool test_pack(bool verbose) {
+	size_t N = 100000;
+	std::default_random_engine generator;
+	std::uniform_int_distribution<uint64_t> distribution;
+
+	std::vector<uint32_t> ids(N);
+	for (auto& v : ids) {
+		v = distribution(generator) % (N * 10);
+	}
+	std::vector<uint32_t> wide32(N);
+	for (auto& v : wide32) {
+		v = distribution(generator);
+	}
+	// Gaps of up to 2^32, and a gap of more, so some blocks are stored raw.
+	std::vector<uint64_t> ids64(N);
+	for (auto& v : ids64) {
+		v = distribution(generator) % (N << 32);
+	}
+	ids64[N / 3] = UINT64_MAX;
+	std::vector<uint64_t> gaps64(N);
+	for (size_t i = 0 ; i < N ; ++i) {
+		gaps64[i] = (distribution(generator) % 7) + (i / 1000);
+	}
+
+	return
+		test_pack_case<uint32_t>("uint32_t", {}) &
+		test_pack_case<uint32_t>("uint32_t", { 42 }) &
+		test_pack_case<uint32_t>("uint32_t", std::vector<uint32_t>(1000, 7)) &
+		test_pack_case<uint32_t>("uint32_t", { 0, UINT32_MAX, UINT32_MAX }) &
+		test_pack_case<uint32_t>("uint32_t", std::vector<uint32_t>(ids.begin(), ids.begin() + 129)) &
+		test_pack_case("uint32_t", ids) &
+		test_pack_case("uint32_t", wide32) &
+		test_pack_case("uint64_t", ids64) &
+		test_pack_case("uint64_t", gaps64);
+}
+
+bool test_apply_rank(bool verbose) {
+	size_t N = 200000;
+	std::default_random_engine generator;
+	std::uniform_int_distribution<uint64_t> distribution;
+
+	auto src = new uint64_t[N];
+	auto dst = new uint64_t[N];
+	auto ib = new uint32_t[N*2];
+
+	for (size_t i = 0 ; i < N ; ++i) {
+		src[i] = distribution(generator);
+	}
+
+	printf("Applying ranks to uint64_t[%zu]... ", N);
+
+	auto ranks = radix_sort_rank(src, ib, N);
+
+	rs_apply_rank(src, dst, ranks, N);
+	bool ok = std::is_sorted(dst, dst + N);
+
+	std::fill(dst, dst + N, 0);
+	rs_apply_rank_parallel(src, dst, ranks, N, 4);
+	ok = ok && std::is_sorted(dst, dst + N);
+
+	rs_apply_rank_inplace(src, ranks, N);
+	ok = ok && std::equal(src, src + N, dst);
+
+	printf("%s\n", ok ? "OK" : "FAILED");
+
+	delete[] src;
+	delete[] dst;
+	delete[] ib;
+
+	return ok;
+}
+
+// Large enough to be sorted indirectly.
+struct bigrec {
+	uint32_t key;
+	uint32_t seq;
+	char payload[120];
+};
+
+auto kdf_bigrec = [](const struct bigrec& entry) -> uint32_t {
+	return entry.key;
+};
+
+// The records are large enough that the sort goes through (key, index)-pairs.
+template<typename KeyFunc>
+bool test_indirect_bigrec_case(size_t N, KeyFunc && kf) {
+	std::default_random_engine generator;
+	std::uniform_int_distribution<uint32_t> distribution(0, 5000);
+
+	auto src = new struct bigrec[N];
+	auto aux = new struct bigrec[N];
+	auto ref = new struct bigrec[N];
+
+	for (size_t i = 0 ; i < N ; ++i) {
+		src[i].key = distribution(generator);
+		src[i].seq = i;
+		std::memset(src[i].payload, i & 0xFF, sizeof(src[i].payload));
+	}
+	std::memcpy(ref, src, sizeof(*src) * N);
+
+	printf("Sorting struct bigrec[%zu] (indirect%s)... ", N, rs_descending_v<KeyFunc> ? ", descending" : "");
+
+	rs_stats stats;
+	auto res = radix_sort(src, aux, N, kf, rs_alloc_malloc(), rs_prefetch_none(), &stats);
+	test_reference_sort(ref, ref + N, kf);
+
+	bool ok = std::memcmp(res, ref, sizeof(*res) * N) == 0 && stats.info.indirect;
+
+	printf("%s\n", ok ? "OK" : "FAILED");
+
+	delete[] src;
+	delete[] aux;
+	delete[] ref;
+
+	return ok;
+}
+
+bool test_indirect_bigrec(bool verbose) {
+	return
+		test_indirect_bigrec_case(20000, kdf_bigrec) &
+		test_indirect_bigrec_case(20000, basic_kdfs::descending(kdf_bigrec));
+}
+
+bool test_stats(bool verbose) {
+	size_t N = 1000;
+	uint32_t src[N];
+	uint32_t aux[N];
+
+	printf("Sorting uint32_t[%zu] (stats)... ", N);
+
+	// Only the two middle columns vary.
+	for (size_t i = 0 ; i < N ; ++i) {
+		src[i] = 0xAA000000 | ((N - i) << 8) | 0x55;
+	}
+
+	rs_stats stats;
+	auto res = radix_sort(src, aux, N, basic_kdfs::kdf<uint32_t>, rs_alloc_malloc(), rs_prefetch_none(), &stats);
+
+	bool ok = std::is_sorted(res, res + N);
+	ok = ok && stats.info.exit == rs_exit::sorted && stats.info.passes == 2 && stats.info.skipped == 0x9;
+	ok = ok && stats.info.counter_bytes == 2 && stats.info.bytes_moved == N * sizeof(uint32_t) * 2;
+
+	res = radix_sort(res, res == src ? aux : src, N, basic_kdfs::kdf<uint32_t>, rs_alloc_malloc(), rs_prefetch_none(), &stats);
+	ok = ok && stats.info.exit == rs_exit::presorted;
+
+	// Inputs smaller than rs_small_n are insertion sorted, and reported as comparison sorts.
+	size_t M = rs_small_n - 1;
+	for (size_t i = 0 ; i < M ; ++i) {
+		src[i] = M - i;
+	}
+	rs_stats small_stats;
+	res = radix_sort(src, aux, M, basic_kdfs::kdf<uint32_t>, rs_alloc_malloc(), rs_prefetch_none(), &small_stats);
+	ok = ok && std::is_sorted(res, res + M);
+	ok = ok && (M < 2 || (small_stats.info.n == M && small_stats.info.key_bytes == 4 && small_stats.info.strategy == rs_strategy::comparison));
+
+	printf("%s\n", ok ? "OK" : "FAILED");
+
+	if (verbose)
+		stats.print(stdout);
+
+	return ok;
+}
+
+bool test_byte_mask(bool verbose) {
+	size_t N = 10000;
+	std::default_random_engine generator;
+	std::uniform_int_distribution<uint64_t> distribution(0, (1ULL << 40) - 1);
+
+	uint64_t *src = new uint64_t[N];
+	uint64_t *aux = new uint64_t[N];
+
+	printf("Sorting uint64_t[%zu] (40-bit byte mask)... ", N);
+
+	for (size_t i = 0 ; i < N ; ++i) {
+		src[i] = distribution(generator);
+	}
+
+	rs_stats stats;
+	auto kf = basic_kdfs::with_byte_mask<0x1F>(basic_kdfs::kdf<uint64_t>);
+	auto res = radix_sort(src, aux, N, kf, rs_alloc_malloc(), rs_prefetch_none(), &stats);
+
+	bool ok = std::is_sorted(res, res + N);
+	ok = ok && stats.info.key_bytes == 5 && (stats.info.skipped & 0xE0) == 0xE0 && stats.info.passes <= 5;
+
+	printf("%s\n", ok ? "OK" : "FAILED");
+
+	if (verbose)
+		stats.print(stdout);
+
+	delete[] aux;
+	delete[] src;
+
+	return ok;
+}
+
+template<typename Alloc>
+bool test_sorter_alloc(const char *name, bool verbose) {
+	size_t N = 100000;
+	std::default_random_engine generator;
+	std::uniform_int_distribution<uint32_t> distribution;
+
+	auto src = new uint32_t[N];
+
+	printf("Sorting uint32_t[%zu] (%s)... ", N, name);
+
+	radix_sorter<uint32_t, Alloc> sorter;
+	bool ok = true;
+	for (size_t n = N/4 ; n <= N ; n *= 2) {
+		for (size_t i = 0 ; i < n ; ++i) {
+			src[i] = distribution(generator);
+		}
+		auto res = sorter.sort(src, n);
+		ok = ok && res && std::is_sorted(res, res + n);
+	}
+
+	for (size_t i = 0 ; i < N ; ++i) {
+		src[i] = distribution(generator);
+	}
+	ok = ok && radix_sort_alloc(src, N, basic_kdfs::kdf<uint32_t>, Alloc());
+	ok = ok && std::is_sorted(src, src + N);
+
+	printf("%s\n", ok ? "OK" : "FAILED");
+
+	delete[] src;
+
+	return ok;
+}
+
 int main(int argc, char *argv[]) {
 	bool verbose = false;
 
 	bool passed =
 		test_sortrec(verbose) &
 		test_sortrec_ptr(verbose) &
+		test_prefetch_ptr(verbose) &
 		test_float(verbose) &
 		test_int(verbose) &
-		test_rank_sortrec(verbose)
+		test_descending(verbose) &
+		test_rank_sortrec(verbose) &
+		test_indirect_bigrec(verbose) &
+		test_apply_rank(verbose) &
+		test_segmented(verbose) &
+		test_merge(verbose) &
+		test_sort_fd(verbose) &
+		test_lazy(verbose) &
+		test_histogram(verbose) &
+		test_adaptive(verbose) &
+		test_inplace(verbose) &
+		test_partition(verbose) &
+		test_cached_keys(verbose) &
+		test_msd_parallel(verbose) &
+		test_onesweep(verbose) &
+		test_sharded(verbose) &
+		test_pack(verbose) &
+		test_stats(verbose) &
+		test_byte_mask(verbose) &
+		test_sorter_alloc<rs_alloc_malloc>("malloc", verbose) &
+		test_sorter_alloc<rs_alloc_prefault<rs_alloc_thp>>("thp, prefault", verbose) &
+		test_sorter_alloc<rs_alloc_hugetlb>("hugetlb", verbose)
 	;
 
 	if (!passed) {
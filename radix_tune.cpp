@@ -0,0 +1,274 @@
+/*
+	Auto-tuner. Benchmarks the available strategies on the local machine, and writes
+	a header with the results, which radix_sort_config.hpp picks up if it's on the
+	include path.
+
+	$ ./radix_tune [<output-file>]
+
+	The default output file is radix_sort_tuning.hpp. `make tune` builds and runs this.
+
+	Tuned:
+		RS_TUNE_SMALL_N            Crossover from insertion sort to radix sort, over several key types.
+		RS_TUNE_GATHER_COST        Cost of the random reads of a gather relative to a sorting pass, per byte,
+		                           which decides when large records are sorted indirectly.
+		RS_TUNE_PREFETCH_DISTANCE  Best rs_prefetch distance when sorting via pointers.
+		RS_TUNE_THREADS            Best number of threads for a memory-bound gather.
+		RS_TUNE_PARALLEL_MIN_N     Smallest number of entries per thread where threading pays off.
+
+	The radix width is fixed at eight bits by the implementation, and is not tuned.
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cinttypes>
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "radix_sort.hpp"
+#include "radix_bench_data.hpp"
+
+// Best (minimum) time in nanoseconds of reps runs of fn, with setup run untimed before each.
+template<typename Setup, typename Fn>
+static double measure_ns(int reps, Setup && setup, Fn && fn) {
+	double best = 1e300;
+	for (int i = 0 ; i < reps ; ++i) {
+		setup();
+		auto start = std::chrono::steady_clock::now();
+		fn();
+		auto end = std::chrono::steady_clock::now();
+		best = std::min(best, (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+	}
+	return best;
+}
+
+// Radix sort without the small input cutoff of radix_sort.
+template<typename T>
+static T* radix_sort_nocutoff(T* src, T* aux, size_t n) {
+	constexpr int passes = sizeof(std::result_of_t<decltype(basic_kdfs::kdf<T>)&(T)>);
+	if (n < 256) {
+		std::array<uint8_t,256*passes> histogram{0};
+		return rs_sort_main(src, aux, n, histogram, basic_kdfs::kdf<T>);
+	}
+	std::array<uint16_t,256*passes> histogram{0};
+	return rs_sort_main(src, aux, n, histogram, basic_kdfs::kdf<T>);
+}
+
+// Smallest n from which radix sort consistently beats insertion sort.
+template<typename T>
+static size_t tune_small_n(const char *type_name) {
+	const size_t sizes[] = { 8, 12, 16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512 };
+	constexpr size_t batch = 256;
+	size_t crossover = 0;
+
+	for (size_t n : sizes) {
+		std::vector<T> org(n * batch);
+		std::vector<T> src(n * batch);
+		std::vector<T> aux(n);
+		rs_generate(org.data(), org.size(), rs_dist::uniform, n);
+		auto setup = [&]() { std::copy(org.begin(), org.end(), src.begin()); };
+
+		double t_ins = measure_ns(5, setup, [&]() {
+			for (size_t b = 0 ; b < batch ; ++b)
+				rs_insertion_sort(src.data() + b * n, n, basic_kdfs::kdf<T>);
+		});
+		double t_radix = measure_ns(5, setup, [&]() {
+			for (size_t b = 0 ; b < batch ; ++b)
+				radix_sort_nocutoff(src.data() + b * n, aux.data(), n);
+		});
+		fprintf(stderr, "small_n %-8s n=%4zu insertion=%8.1f ns radix=%8.1f ns\n", type_name, n, t_ins / batch, t_radix / batch);
+
+		if (t_radix < t_ins) {
+			if (crossover == 0)
+				crossover = n;
+		} else {
+			crossover = 0;
+		}
+	}
+	return crossover ? crossover : sizes[std::size(sizes) - 1];
+}
+
+// One counting sort pass of records on their low key byte, like a direct sorting pass.
+template<size_t S>
+static void scatter_pass(const bench_rec<S>* src, bench_rec<S>* dst, size_t n) {
+	size_t cnt[256] = { 0 };
+	for (size_t i = 0 ; i < n ; ++i) {
+		cnt[src[i].key & 0xFF]++;
+	}
+	size_t a = 0;
+	for (int j = 0 ; j < 256 ; ++j) {
+		size_t b = cnt[j];
+		cnt[j] = a;
+		a += b;
+	}
+	for (size_t i = 0 ; i < n ; ++i) {
+		dst[cnt[src[i].key & 0xFF]++] = src[i];
+	}
+}
+
+// Estimate the gather cost for records of size S, see rs_prefer_indirect.
+// A sorting pass (histogram read + scatter read and write) is 3*S bytes of traffic, which
+// gives the cost per byte. The gather is charged rs_gather_cost * max(S, cacheline) for
+// the random read, and S for the sequential write.
+template<size_t S>
+static double tune_gather_cost(void) {
+	size_t n = (1UL << 25) / S;
+	std::vector<bench_rec<S>> src(n);
+	std::vector<bench_rec<S>> dst(n);
+	std::vector<uint32_t> ranks(n);
+	rs_generate(src.data(), n, rs_dist::uniform, S);
+	std::iota(ranks.begin(), ranks.end(), 0);
+	std::shuffle(ranks.begin(), ranks.end(), std::mt19937(S));
+
+	auto nop = []() { };
+	double t_pass = measure_ns(5, nop, [&]() { scatter_pass(src.data(), dst.data(), n); });
+	double t_gather = measure_ns(5, nop, [&]() { rs_apply_rank(src.data(), dst.data(), ranks.data(), n); });
+
+	double ns_per_byte = t_pass / (n * 3.0 * S);
+	double cost = (t_gather / (n * ns_per_byte) - S) / std::max(S, rs_cacheline);
+	fprintf(stderr, "gather   rec%-4zu pass=%6.2f ns gather=%6.2f ns cost=%.2f\n", S, t_pass / n, t_gather / n, cost);
+	return std::clamp(cost, 0.5, 16.0);
+}
+
+struct ptr_rec {
+	uint32_t key;
+	uint32_t pad[15];
+};
+
+static size_t tune_prefetch_distance(void) {
+	const size_t distances[] = { 0, 2, 4, 8, 16, 32, 64 };
+	size_t n = 1UL << 20;
+	std::vector<ptr_rec> recs(n);
+	std::vector<const ptr_rec*> org(n);
+	std::vector<const ptr_rec*> src(n);
+	std::vector<const ptr_rec*> aux(n);
+	std::mt19937 generator(n);
+	for (size_t i = 0 ; i < n ; ++i) {
+		recs[i].key = generator();
+		org[i] = &recs[i];
+	}
+	std::shuffle(org.begin(), org.end(), generator);
+
+	auto kf = [](const ptr_rec* entry) -> uint32_t { return entry->key; };
+	auto setup = [&]() { std::copy(org.begin(), org.end(), src.begin()); };
+
+	size_t best_distance = rs_prefetch_distance;
+	double best = 1e300;
+	for (size_t distance : distances) {
+		double t;
+		if (distance == 0) {
+			t = measure_ns(3, setup, [&]() { radix_sort(src.data(), aux.data(), n, kf); });
+		} else {
+			t = measure_ns(3, setup, [&]() { radix_sort(src.data(), aux.data(), n, kf, rs_alloc_malloc(), rs_prefetch { distance }); });
+		}
+		fprintf(stderr, "prefetch distance=%2zu %8.2f ns/key\n", distance, t / n);
+		// Zero is only a baseline; the distance is used when prefetching is asked for.
+		if (distance != 0 && t < best) {
+			best = t;
+			best_distance = distance;
+		}
+	}
+	return best_distance;
+}
+
+// A gather over n entries split into contiguous ranges over threads.
+static double time_parallel_gather(const std::vector<uint64_t>& src, std::vector<uint64_t>& dst, const std::vector<uint32_t>& ranks, size_t n, unsigned int threads) {
+	auto nop = []() { };
+	return measure_ns(5, nop, [&]() {
+		std::vector<std::thread> workers;
+		size_t chunk = (n + threads - 1) / threads;
+		for (size_t start = 0 ; start < n ; start += chunk) {
+			size_t len = std::min(chunk, n - start);
+			workers.emplace_back([&, start, len]() {
+				rs_apply_rank(src.data(), dst.data() + start, ranks.data() + start, len);
+			});
+		}
+		for (auto& w : workers) {
+			w.join();
+		}
+	});
+}
+
+static void tune_threads(unsigned int *best_threads, size_t *min_per_thread) {
+	unsigned int hw = std::max(1U, std::thread::hardware_concurrency());
+	size_t n = 1UL << 23;
+	std::vector<uint64_t> src(n);
+	std::vector<uint64_t> dst(n);
+	std::vector<uint32_t> ranks(n);
+	std::iota(ranks.begin(), ranks.end(), 0);
+	std::shuffle(ranks.begin(), ranks.end(), std::mt19937(n));
+
+	*best_threads = 1;
+	*min_per_thread = rs_parallel_min_n;
+	if (hw == 1) {
+		fprintf(stderr, "threads  only one hardware thread\n");
+		return;
+	}
+
+	double best = 1e300;
+	for (unsigned int t = 1 ; t <= hw ; t = (t * 2 > hw && t != hw) ? hw : t * 2) {
+		double ns = time_parallel_gather(src, dst, ranks, n, t);
+		fprintf(stderr, "threads  t=%2u %8.2f ns/key\n", t, ns / n);
+		if (ns < best) {
+			best = ns;
+			*best_threads = t;
+		}
+	}
+
+	if (*best_threads > 1) {
+		for (size_t per_thread = 1UL << 10 ; per_thread <= n / *best_threads ; per_thread *= 2) {
+			size_t m = per_thread * *best_threads;
+			double t1 = time_parallel_gather(src, dst, ranks, m, 1);
+			double tn = time_parallel_gather(src, dst, ranks, m, *best_threads);
+			fprintf(stderr, "threads  n=%8zu single=%10.0f ns threaded=%10.0f ns\n", m, t1, tn);
+			if (tn < t1) {
+				*min_per_thread = per_thread;
+				break;
+			}
+		}
+	}
+}
+
+auto main(int argc, char *argv[]) -> int
+{
+	const char *out_fn = argc > 1 ? argv[1] : "radix_sort_tuning.hpp";
+
+	size_t small_n = std::min({ tune_small_n<uint32_t>("uint32_t"), tune_small_n<uint64_t>("uint64_t"), tune_small_n<double>("double") });
+
+	double costs[] = { tune_gather_cost<32>(), tune_gather_cost<64>(), tune_gather_cost<128>(), tune_gather_cost<256>() };
+	std::sort(std::begin(costs), std::end(costs));
+	double gather_cost = (costs[1] + costs[2]) / 2;
+
+	size_t prefetch_distance = tune_prefetch_distance();
+
+	unsigned int threads;
+	size_t min_per_thread;
+	tune_threads(&threads, &min_per_thread);
+
+	FILE *f = fopen(out_fn, "w");
+	if (!f) {
+		fprintf(stderr, "Error: could not open '%s' for writing.\n", out_fn);
+		return EXIT_FAILURE;
+	}
+
+	time_t now = time(nullptr);
+	char date[32];
+	strftime(date, sizeof(date), "%Y-%m-%d", localtime(&now));
+	fprintf(f, "// Generated by radix_tune on %s for this machine. See radix_sort_config.hpp.\n", date);
+	fprintf(f, "#pragma once\n\n");
+	fprintf(f, "#define RS_TUNE_SMALL_N %zu\n", small_n);
+	fprintf(f, "#define RS_TUNE_GATHER_COST %.2f\n", gather_cost);
+	fprintf(f, "#define RS_TUNE_PREFETCH_DISTANCE %zu\n", prefetch_distance);
+	fprintf(f, "#define RS_TUNE_THREADS %u\n", threads);
+	fprintf(f, "#define RS_TUNE_PARALLEL_MIN_N %zu\n", min_per_thread);
+	fclose(f);
+
+	printf("Wrote '%s': small_n=%zu gather_cost=%.2f prefetch_distance=%zu threads=%u parallel_min_n=%zu\n",
+		out_fn, small_n, gather_cost, prefetch_distance, threads, min_per_thread);
+
+	return EXIT_SUCCESS;
+}
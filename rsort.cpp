@@ -0,0 +1,245 @@
+/*
+	Sort a binary file of fixed-size records by a key field.
+
+	$ ./rsort [-r <record-size>] [-o <key-offset>] [-t <key-type>] [-d] [-v] <input> <output>
+
+	The key type is one of uint8_t, uint16_t, uint32_t, uint64_t, int8_t, int16_t, int32_t,
+	int64_t, float or double, in native byte order. The record size defaults to the size of
+	the key type, i.e a plain array of keys, and the key offset to zero. -d sorts in descending
+	order. The sort is stable.
+
+	Example, sorting 16-byte records by a little-endian double at offset 8:
+
+	$ ./rsort -r 16 -o 8 -t double records.dat sorted.dat
+
+	The input is mapped read-only, and the output is created at the final size and mapped
+	shared, so the sorted records are written straight into the page cache of the output
+	file. The keys are extracted into (key, index)-pairs, which are radix sorted, and the
+	records are then gathered into the output in one pass. Both mappings are populated up
+	front, and huge pages are requested for them and for the pairs.
+
+	Throughput of each phase is reported on stderr.
+*/
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cinttypes>
+#include <ctime>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "radix_sort.hpp"
+
+struct options {
+	size_t rec_size = 0;
+	size_t key_offset = 0;
+	const char *key_type = "uint32_t";
+	bool descending = false;
+	bool verbose = false;
+};
+
+static double now_s(void) {
+	struct timespec tp;
+	clock_gettime(CLOCK_MONOTONIC, &tp);
+	return tp.tv_sec + tp.tv_nsec / 1.0e9;
+}
+
+static void report(const char *phase, double seconds, size_t n, size_t bytes) {
+	fprintf(stderr, "%10s: %9.3f ms %10.2f Mrec/s %10.2f MB/s\n", phase, seconds * 1e3, n / seconds / 1e6, bytes / seconds / 1e6);
+}
+
+// Copy the records to dst in the order of the sorted pairs. Each record is prefetched
+// a block ahead, as the reads are random.
+template<typename P>
+static void gather_records(const uint8_t* RESTRICT src, uint8_t* RESTRICT dst, const P* pairs, size_t n, size_t rec_size) {
+	constexpr size_t ahead = 16;
+	for (size_t i = 0 ; i < n ; ++i) {
+		if (i + ahead < n)
+			__builtin_prefetch(src + pairs[i + ahead].idx * rec_size);
+		std::memcpy(dst + i * rec_size, src + pairs[i].idx * rec_size, rec_size);
+	}
+}
+
+template<typename K, typename IdxType>
+static bool sort_records(const uint8_t *src, uint8_t *dst, size_t n, const options& opt) {
+	typedef std::result_of_t<decltype(basic_kdfs::kdf<K>)&(K)> KeyType;
+	typedef rs_keyidx<KeyType, IdxType> P;
+	const rs_alloc_thp alloc;
+	size_t bytes = n * opt.rec_size;
+
+	P *pairs = static_cast<P*>(alloc.allocate(sizeof(P) * n * 2));
+	if (!pairs) {
+		fprintf(stderr, "Error: could not allocate %zu bytes for the sort keys.\n", sizeof(P) * n * 2);
+		return false;
+	}
+
+	double t0 = now_s();
+	for (size_t i = 0 ; i < n ; ++i) {
+		K key;
+		std::memcpy(&key, src + i * opt.rec_size + opt.key_offset, sizeof(key));
+		pairs[i] = { basic_kdfs::kdf<K>(key), IdxType(i) };
+	}
+
+	double t1 = now_s();
+	auto pair_key = [](const P& p) -> KeyType { return p.key; };
+	rs_stats stats;
+	const P *sorted;
+	if (opt.descending) {
+		sorted = radix_sort(pairs, pairs + n, n, basic_kdfs::descending(pair_key), alloc, rs_prefetch_none(), &stats);
+	} else {
+		sorted = radix_sort(pairs, pairs + n, n, pair_key, alloc, rs_prefetch_none(), &stats);
+	}
+
+	double t2 = now_s();
+	gather_records(src, dst, sorted, n, opt.rec_size);
+	double t3 = now_s();
+
+	report("keys", t1 - t0, n, bytes);
+	report("sort", t2 - t1, n, sizeof(P) * n);
+	report("gather", t3 - t2, n, bytes);
+	if (opt.verbose)
+		stats.print(stderr);
+
+	alloc.deallocate(pairs, sizeof(P) * n * 2);
+	return true;
+}
+
+template<typename K>
+static bool sort_records(const uint8_t *src, uint8_t *dst, size_t n, const options& opt) {
+	if (n <= UINT32_MAX)
+		return sort_records<K, uint32_t>(src, dst, n, opt);
+	return sort_records<K, uint64_t>(src, dst, n, opt);
+}
+
+static size_t key_size(const char *key_type) {
+	const struct { const char *name; size_t size; } types[] = {
+		{ "uint8_t", 1 }, { "uint16_t", 2 }, { "uint32_t", 4 }, { "uint64_t", 8 },
+		{ "int8_t", 1 }, { "int16_t", 2 }, { "int32_t", 4 }, { "int64_t", 8 },
+		{ "float", 4 }, { "double", 8 },
+	};
+	for (const auto& t : types) {
+		if (strcmp(key_type, t.name) == 0)
+			return t.size;
+	}
+	return 0;
+}
+
+static bool dispatch(const uint8_t *src, uint8_t *dst, size_t n, const options& opt) {
+	const char *kt = opt.key_type;
+	if (strcmp(kt, "uint8_t") == 0) return sort_records<uint8_t>(src, dst, n, opt);
+	if (strcmp(kt, "uint16_t") == 0) return sort_records<uint16_t>(src, dst, n, opt);
+	if (strcmp(kt, "uint32_t") == 0) return sort_records<uint32_t>(src, dst, n, opt);
+	if (strcmp(kt, "uint64_t") == 0) return sort_records<uint64_t>(src, dst, n, opt);
+	if (strcmp(kt, "int8_t") == 0) return sort_records<int8_t>(src, dst, n, opt);
+	if (strcmp(kt, "int16_t") == 0) return sort_records<int16_t>(src, dst, n, opt);
+	if (strcmp(kt, "int32_t") == 0) return sort_records<int32_t>(src, dst, n, opt);
+	if (strcmp(kt, "int64_t") == 0) return sort_records<int64_t>(src, dst, n, opt);
+	if (strcmp(kt, "float") == 0) return sort_records<float>(src, dst, n, opt);
+	if (strcmp(kt, "double") == 0) return sort_records<double>(src, dst, n, opt);
+	return false;
+}
+
+static void usage(const char *argv0) {
+	fprintf(stderr, "Usage: %s [-r <record-size>] [-o <key-offset>] [-t <uint8_t|uint16_t|uint32_t|uint64_t|int8_t|int16_t|int32_t|int64_t|float|double>] [-d] [-v] <input> <output>\n", argv0);
+}
+
+auto main(int argc, char *argv[]) -> int
+{
+	options opt;
+	int c;
+	while ((c = getopt(argc, argv, "r:o:t:dvh")) != -1) {
+		switch (c) {
+			case 'r': opt.rec_size = strtoull(optarg, nullptr, 0); break;
+			case 'o': opt.key_offset = strtoull(optarg, nullptr, 0); break;
+			case 't': opt.key_type = optarg; break;
+			case 'd': opt.descending = true; break;
+			case 'v': opt.verbose = true; break;
+			default:
+				usage(argv[0]);
+				return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+	if (argc - optind != 2) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	const char *in_fn = argv[optind];
+	const char *out_fn = argv[optind + 1];
+
+	size_t ksize = key_size(opt.key_type);
+	if (ksize == 0) {
+		fprintf(stderr, "Error: unknown key type, '%s'.\n", opt.key_type);
+		return EXIT_FAILURE;
+	}
+	if (opt.rec_size == 0)
+		opt.rec_size = ksize;
+	if (opt.key_offset + ksize > opt.rec_size) {
+		fprintf(stderr, "Error: key at offset %zu of %zu bytes does not fit in a %zu byte record.\n", opt.key_offset, ksize, opt.rec_size);
+		return EXIT_FAILURE;
+	}
+
+	double t0 = now_s();
+
+	int in_fd = open(in_fn, O_RDONLY);
+	struct stat st;
+	if (in_fd < 0 || fstat(in_fd, &st) != 0) {
+		fprintf(stderr, "Error: could not open '%s': %s\n", in_fn, strerror(errno));
+		return EXIT_FAILURE;
+	}
+	size_t bytes = st.st_size;
+	if (bytes % opt.rec_size != 0) {
+		fprintf(stderr, "Error: size of '%s', %zu bytes, is not a multiple of the record size, %zu bytes.\n", in_fn, bytes, opt.rec_size);
+		return EXIT_FAILURE;
+	}
+	size_t n = bytes / opt.rec_size;
+
+	// Truncating the output would destroy the input, before it's read.
+	struct stat out_st;
+	if (stat(out_fn, &out_st) == 0 && out_st.st_dev == st.st_dev && out_st.st_ino == st.st_ino) {
+		fprintf(stderr, "Error: '%s' and '%s' are the same file.\n", in_fn, out_fn);
+		return EXIT_FAILURE;
+	}
+
+	int out_fd = open(out_fn, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (out_fd < 0 || ftruncate(out_fd, bytes) != 0) {
+		fprintf(stderr, "Error: could not create '%s': %s\n", out_fn, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	if (n == 0)
+		return EXIT_SUCCESS;
+
+	const uint8_t *src = static_cast<const uint8_t*>(mmap(NULL, bytes, PROT_READ, MAP_PRIVATE | MAP_POPULATE, in_fd, 0));
+	uint8_t *dst = static_cast<uint8_t*>(mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, out_fd, 0));
+	if (src == MAP_FAILED || dst == MAP_FAILED) {
+		fprintf(stderr, "Error: could not map the files: %s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+	// Only honored for file systems with large folio support; otherwise harmless.
+	madvise(const_cast<uint8_t*>(src), bytes, MADV_HUGEPAGE);
+	madvise(dst, bytes, MADV_HUGEPAGE);
+
+	double t1 = now_s();
+	fprintf(stderr, "Sorting %zu records of %zu bytes by %s at offset %zu%s.\n", n, opt.rec_size, opt.key_type, opt.key_offset, opt.descending ? ", descending" : "");
+	report("map", t1 - t0, n, bytes);
+
+	if (!dispatch(src, dst, n, opt))
+		return EXIT_FAILURE;
+
+	double t2 = now_s();
+	if (munmap(dst, bytes) != 0 || munmap(const_cast<uint8_t*>(src), bytes) != 0 || close(out_fd) != 0) {
+		fprintf(stderr, "Error: could not write '%s': %s\n", out_fn, strerror(errno));
+		return EXIT_FAILURE;
+	}
+	close(in_fd);
+	double t3 = now_s();
+
+	report("unmap", t3 - t2, n, bytes);
+	report("total", t3 - t0, n, bytes);
+
+	return EXIT_SUCCESS;
+}